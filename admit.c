@@ -0,0 +1,121 @@
+/*
+ * admit.c - 진입 제어와 503 부하 차단 (-L, -P, -M)
+ *
+ * 과부하일 때 모든 연결을 받아 큐에 쌓으면 받아들인 요청까지 함께
+ * 느려져서 결국 모두 타임아웃이 난다. 여기서는 accept 직후에 한도를
+ * 확인하고, 넘으면 큐에 넣지 않고 미리 만들어 둔 503 응답을 바로
+ * 보낸 뒤 닫는다. 받아들인 요청의 지연은 한도 안에서 유지된다.
+ *
+ * 연결은 두 단계로 센다:
+ * - 대기(pending): 받았지만 아직 doit 을 시작하지 않음 (sbuf 나 덱에 있음)
+ * - 처리 중(in-flight): doit 이나 이벤트 루프가 처리하고 있음
+ *
+ * 한도 (0이면 없음):
+ * - -P max_pending: 대기 연결 수. pool/steal 모드의 큐 길이를 제한한다.
+ * - -L max_inflight: 처리 중 연결 수. 대기 단계가 없는 모드(thread,
+ *   epoll, uring, coro)에서는 받은 연결이 곧바로 처리 중이 되므로
+ *   대기+처리 중 합계를 max_inflight + max_pending 으로 제한한다.
+ * - -M mem_budget: 연결 하나가 ADMIT_CONN_COST 바이트를 쓴다고 보고
+ *   대기+처리 중 연결이 쓰는 메모리를 제한한다.
+ */
+#include "csapp.h"
+#include "admit.h"
+
+#define ADMIT_CONN_COST   (64 * 1024)   /* 연결 하나의 추정 메모리 (doit 의 rio_t 2개 + 줄 버퍼들) */
+#define ADMIT_RETRY_AFTER 1             /* 503 의 Retry-After (초) */
+
+static int max_inflight, max_pending;
+static long mem_budget;
+
+static int ninflight, npending;
+static unsigned long nadmitted;
+static unsigned long rej_inflight, rej_pending, rej_memory;
+
+/* 거절할 때 보내는 응답 (본문 포함 한 번의 send 로 끝나는 크기) */
+#define STR(x) #x
+#define XSTR(x) STR(x)
+static const char reject_msg[] =
+    "HTTP/1.0 503 Service Unavailable\r\n"
+    "Retry-After: " XSTR(ADMIT_RETRY_AFTER) "\r\n"
+    "Content-Type: text/plain\r\n"
+    "Content-Length: 20\r\n"
+    "Connection: close\r\n"
+    "\r\n"
+    "proxy is overloaded\n";
+
+void admit_init(int inflight, int pending, long budget) {
+    max_inflight = inflight;
+    max_pending = pending;
+    mem_budget = budget;
+}
+
+/*
+ * admit_send_busy - 미리 만들어 둔 503 응답을 보냄 (블로킹하지 않음)
+ * 반환값: 보냈으면 1, 소켓 버퍼가 차 있거나 오류면 0
+ */
+int admit_send_busy(int fd) {
+    return send(fd, reject_msg, sizeof(reject_msg) - 1, MSG_DONTWAIT | MSG_NOSIGNAL) > 0;
+}
+
+/*
+ * reject - 503 을 보내고 연결을 닫음 (accept 경로에서 불리므로 블로킹하지 않음)
+ *
+ * 읽지 않은 요청이 소켓에 남은 채로 닫으면 커널이 RST 를 보내 클라이언트가
+ * 503 을 못 받을 수 있으므로, 이미 도착한 만큼은 비우고 닫는다.
+ */
+static void reject(int fd) {
+    char buf[1024];
+    int i;
+
+    if (admit_send_busy(fd)) {
+        shutdown(fd, SHUT_WR);
+        for (i = 0; i < 4 && recv(fd, buf, sizeof(buf), MSG_DONTWAIT) > 0; i++)
+            ;
+    }
+    close(fd);
+}
+
+int admit_accept(int fd) {
+    int pending = __atomic_add_fetch(&npending, 1, __ATOMIC_RELAXED);
+    int total = pending + __atomic_load_n(&ninflight, __ATOMIC_RELAXED);
+    unsigned long *why = NULL;
+
+    if (max_pending > 0 && pending > max_pending)
+        why = &rej_pending;
+    else if (max_inflight > 0 && total > max_inflight + max_pending)
+        why = &rej_inflight;
+    else if (mem_budget > 0 && (long)total * ADMIT_CONN_COST > mem_budget)
+        why = &rej_memory;
+
+    if (why) {
+        __atomic_sub_fetch(&npending, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(why, 1, __ATOMIC_RELAXED);
+        reject(fd);
+        return 0;
+    }
+    __atomic_add_fetch(&nadmitted, 1, __ATOMIC_RELAXED);
+    return 1;
+}
+
+void admit_begin(void) {
+    __atomic_add_fetch(&ninflight, 1, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&npending, 1, __ATOMIC_RELAXED);
+}
+
+void admit_end(void) {
+    __atomic_sub_fetch(&ninflight, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * admit_stats - 현재 대기/처리 중 연결 수와 한도별 거절 횟수 출력
+ */
+void admit_stats(FILE *fp) {
+    fprintf(fp, "admit: inflight %d pending %d admitted %lu rejected "
+                "(inflight %lu pending %lu memory %lu)\n",
+            __atomic_load_n(&ninflight, __ATOMIC_RELAXED),
+            __atomic_load_n(&npending, __ATOMIC_RELAXED),
+            __atomic_load_n(&nadmitted, __ATOMIC_RELAXED),
+            __atomic_load_n(&rej_inflight, __ATOMIC_RELAXED),
+            __atomic_load_n(&rej_pending, __ATOMIC_RELAXED),
+            __atomic_load_n(&rej_memory, __ATOMIC_RELAXED));
+}
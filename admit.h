@@ -0,0 +1,25 @@
+/*
+ * admit.h - 진입 제어와 503 부하 차단 (-L, -P, -M)
+ */
+#ifndef __ADMIT_H__
+#define __ADMIT_H__
+
+#include <stdio.h>
+
+/* 한도 설정 (0이면 그 한도는 없음). mem_budget 은 바이트 단위 */
+void admit_init(int max_inflight, int max_pending, long mem_budget);
+
+/* 방금 받은 연결을 받아들일지 결정: 받아들이면 1 (대기 상태가 됨),
+ * 한도를 넘으면 503 을 보내고 소켓을 닫은 뒤 0 */
+int admit_accept(int fd);
+
+/* 받아들인 연결의 처리를 시작 (대기 → 처리 중) / 끝냄 */
+void admit_begin(void);
+void admit_end(void);
+
+/* 503 + Retry-After 응답만 보냄 (소켓은 닫지 않음, 블로킹하지 않음) */
+int admit_send_busy(int fd);
+
+void admit_stats(FILE *fp);
+
+#endif /* __ADMIT_H__ */
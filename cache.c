@@ -0,0 +1,843 @@
+/*
+ * cache.c - 웹 객체 캐시 (샤딩, LRU / TinyLFU / GDSF 정책)
+ *
+ * 요청 URI 를 키로 서버 응답 전체를 메모리에 보관한다.
+ *
+ * - 캐시는 2의 거듭제곱 개의 샤드로 나뉜다. 정규화한 URI 의 해시로 샤드를
+ *   고르고, 샤드마다 잠금, 해시 테이블, LRU 목록, 용량(max_cache / 샤드 수)을
+ *   따로 가지므로 서로 다른 샤드의 요청은 서로 기다리지 않는다.
+ *   -c 를 주면 i 번째 샤드의 구조체와 해시 테이블은 i 번째 워커가 고정되는
+ *   CPU (topo_cpu(i)) 의 노드에 할당한다 (topo.c). 모든 샤드가 main 스레드의
+ *   노드에 몰리지 않고 워커들이 있는 노드들에 고르게 나뉜다.
+ * - URI 는 스킴과 호스트의 대소문자, 기본 포트(:80), 빈 경로를 정규화한
+ *   뒤 키로 쓴다. 같은 객체를 가리키는 표기가 한 항목으로 모인다.
+ * - 용량은 바이트 단위로 정확히 센다: 응답 본문뿐 아니라 객체 구조체와
+ *   키 문자열도 포함된다. max_object 는 응답 크기 한도다.
+ * - 읽기는 잠금 없이 한다. 객체는 들어간 뒤 바뀌지 않고, 쓰는 쪽(샤드마다
+ *   뮤텍스로 직렬화)은 다 만든 객체를 해시 체인에 원자적으로 걸거나
+ *   기존 객체와 바꿔 끼운다. 읽는 쪽은 epoch 읽기 구간(epoch.c) 안에서
+ *   체인을 따라가므로, 체인에서 빠진 객체는 그것을 볼 수 있었던 읽기가
+ *   모두 끝난 뒤에야 캐시의 참조를 놓는다.
+ * - 적중한 요청은 읽기 구간 안에서 참조 수를 올려 객체를 가져가고, 보내는
+ *   동안은 구간 밖에 있다 (느린 클라이언트가 회수를 막지 않음). 마지막
+ *   참조가 돌아올 때 해제된다.
+ * - 적중이 공유 메모리에 쓰는 것은 이 참조 수와, 밀리초에 한 번 이하로
+ *   갱신하는 last_use 뿐이다. LRU 목록은 쓰는 쪽이 내보낼 때 정리한다:
+ *   목록 끝의 객체가 자리를 옮긴 뒤(lru_stamp) 다시 쓰였으면 앞으로
+ *   옮기고, 아니면 내보낸다.
+ * - 적중/미스 횟수도 한 곳에 모으면 캐시 라인이 오가므로 스레드별로
+ *   나눈 칸(stripe)에 센다.
+ *
+ * 신선도: 객체마다 서버 응답 헤더로 정한 만료 시각(expires)이 있다
+ * (fresh.c). 만료된 객체도 조회는 되지만 미스로 세고, 호출한 쪽이 그
+ * 검증자(ETag, Last-Modified)로 서버에 재검증한다. 304 가 오면 본문은
+ * 그대로 두고 expires 만 원자적으로 늘린다 (cache_refresh). 만료된 뒤에도
+ * 재검증 유예 기간(swr) 안이면 그대로 보내도 되므로 적중으로 센다 (재검증은
+ * refresh.c 가 백그라운드에서 한다). 서버가 실패했을 때 대신 보내도 되는
+ * 기간(sie, stale-if-error)도 객체마다 따로 둔다.
+ *
+ * 변형: 응답에 Vary 가 있었으면 같은 URI 에 변형을 여럿 둔다 (vary.c). 해시
+ * 체인에는 항목마다 객체 하나만 걸리고, 다른 변형들은 그 객체의 변형
+ * 목록(variants)에 달린다. 조회는 URI 로 항목을 찾은 뒤 요청 헤더로 만든
+ * 변형 키로 목록을 훑는다 (보조 색인). 변형들은 항목 하나로 LRU 자리와
+ * 빈도를 함께 쓰고, 그 charge 는 항목의 vcharge 로 더해져 용량과 내보내기에
+ * 함께 센다. 항목을 내보내면 변형들도 함께 나간다. 항목마다 변형은
+ * CACHE_MAX_VARIANTS 개까지 두고, 넘치면 목록에서 가장 오래된 변형을 뺀다
+ * (해시 체인에 걸린 객체는 항목과 함께만 나감).
+ * 변형 목록도 해시 체인처럼 다 만든 객체를 원자적으로 걸고, 빠진 변형은
+ * epoch 로 회수한다. Vary 이름 목록이 다른 응답이 오면 변형들을 모두 버린다.
+ *
+ * 교체 정책 (-E):
+ * - lru: 자리가 모자라면 LRU 순서대로 내보낸다.
+ * - tinylfu: 샤드마다 빈도 추정기(sketch.c)를 두고 모든 조회를 기록한다.
+ *   새 객체가 들어가려고 자리를 비워야 할 때, 내보낼 LRU 객체보다 새
+ *   객체의 추정 빈도가 높을 때만 받아들인다. 한 번만 요청되는 객체나
+ *   훑고 지나가는 요청이 자주 쓰는 객체를 밀어내지 못한다.
+ * - gdsf (Greedy-Dual-Size-Frequency): 객체마다 우선순위
+ *   H = L + 빈도 x 비용 / 크기 를 두고 샤드별 최소 힙에서 H 가 가장 작은
+ *   것부터 내보낸다. L 은 마지막으로 내보낸 객체의 H 라서, 오래 쓰이지 않은
+ *   객체는 새로 들어오거나 다시 쓰인 객체보다 점점 뒤처진다. 비용은 모두
+ *   GDSF_COST 로 같게 두므로 작은 객체를 많이 남겨 객체 적중률을 높인다.
+ *   적중은 freq 만 올리고, 힙은 LRU 목록처럼 쓰는 쪽이 내보낼 때 정리한다:
+ *   힙 맨 위 객체의 freq 가 H 를 계산한 뒤 바뀌었으면 다시 계산해 내린다.
+ *
+ * 적중률은 요청 수 기준(객체 적중률)과 보낸 바이트 기준(바이트 적중률)을
+ * 함께 센다. 작은 객체를 선호하는 gdsf 는 앞쪽이, lru 는 뒤쪽이 높게
+ * 나오기 쉬우므로 둘을 보고 배포마다 정책을 고른다.
+ *
+ * 샤드 수를 조정할 수 있도록 샤드별 적중률과 (쓰는 쪽) 잠금 대기 시간을 센다.
+ */
+#include "csapp.h"
+#include "cache.h"
+#include "epoch.h"
+#include "sketch.h"
+#include "topo.h"
+#include "vary.h"
+
+#define CACHE_MIN_BUCKETS 64
+#define CACHE_MAX_BUCKETS (1 << 20)
+#define CACHE_AVG_OBJECT  4096      /* 버킷 수를 정할 때 가정하는 평균 객체 크기 */
+#define CACHE_MAX_SHARDS  16        /* 샤드 수 기본값의 상한 */
+#define CACHE_STRIPES     16        /* 적중/미스 카운터를 나누는 칸 수 */
+#define GDSF_COST         1.0       /* gdsf: 객체 하나를 다시 가져오는 비용 */
+#define CACHE_MAX_VARIANTS 8        /* URI 하나에 두는 변형 수 */
+
+/* 스레드들이 나눠 쓰는 카운터 칸 */
+typedef struct {
+    unsigned long hits, misses;
+    unsigned long stale;            /* 미스 가운데 만료된 객체를 찾은 수 */
+    unsigned long hit_bytes, miss_bytes;
+} __attribute__((aligned(64))) cstripe_t;
+
+/* 샤드 하나: 다른 샤드와 캐시 라인을 공유하지 않도록 정렬 */
+typedef struct {
+    pthread_mutex_t lock;           /* 쓰는 쪽만 잡음 */
+    cobj_t **buckets;
+    unsigned nbuckets;              /* 2의 거듭제곱 */
+    cobj_t *lru_head, *lru_tail;    /* head 가 가장 최근 */
+    size_t used;                    /* 차지한 바이트 합 (charge 의 합) */
+    size_t budget;                  /* 이 샤드의 용량 */
+    int nobjs;
+    int nvariants;                  /* 항목들의 변형 목록에 달린 객체 수 */
+    unsigned long nevicts, ninserts;
+    unsigned long nrejects;         /* tinylfu 가 받아들이지 않은 객체 수 */
+    sketch_t sk;                    /* tinylfu 빈도 추정기 */
+    cobj_t **heap;                  /* gdsf 우선순위 큐 (prio 최소 힙) */
+    int heap_len, heap_cap;
+    double clock;                   /* gdsf 의 L: 마지막으로 내보낸 객체의 prio */
+    unsigned long nwaits;           /* 잠금을 바로 잡지 못한 횟수 */
+    unsigned long wait_ns;          /* 잠금을 기다린 시간 합 */
+    cstripe_t stripes[CACHE_STRIPES];
+} __attribute__((aligned(64))) cshard_t;
+
+static size_t max_cache, max_object;
+static int policy;
+static cshard_t **shards;           /* 샤드마다 따로 (노드 로컬로) 할당 */
+static int nshards;                 /* 2의 거듭제곱 */
+static int shard_bits;
+static cstripe_t byte_stripes[CACHE_STRIPES];   /* 샤드를 모르는 미스 바이트용 */
+static unsigned long nrefreshed;    /* 304 로 재검증된 횟수 */
+
+static unsigned next_stripe;
+static __thread int my_stripe = -1; /* 이 스레드가 쓰는 카운터 칸 */
+
+/* FNV-1a */
+static unsigned hash_key(const char *key) {
+    unsigned h = 2166136261u;
+
+    while (*key)
+        h = (h ^ (unsigned char)*key++) * 16777619u;
+    return h;
+}
+
+/*
+ * cache_key - URI 를 "host[:port]/path" 형태의 캐시 키로 정규화
+ *
+ * "http://" 를 떼고, 호스트는 소문자로, :80 은 생략, 경로가 없으면 "/".
+ * out 은 strlen(uri) + 2 바이트 이상이어야 한다.
+ */
+void cache_key(const char *uri, char *out) {
+    const char *p = uri;
+    char *o = out;
+
+    if (!strncasecmp(p, "http://", 7))
+        p += 7;
+    while (*p && *p != ':' && *p != '/')
+        *o++ = tolower((unsigned char)*p++);
+    if (*p == ':') {
+        if (!strncmp(p, ":80", 3) && (p[3] == '/' || p[3] == '\0'))
+            p += 3;
+        else
+            while (*p && *p != '/')
+                *o++ = *p++;
+    }
+    if (*p != '/')
+        *o++ = '/';
+    strcpy(o, p);
+}
+
+static const char *policy_names[] = { "lru", "tinylfu", "gdsf" };
+
+/* cache_policy - 정책 이름을 enum cache_policy 로 (모르는 이름이면 -1) */
+int cache_policy(const char *name) {
+    int i;
+
+    for (i = 0; i < (int)(sizeof(policy_names) / sizeof(policy_names[0])); i++)
+        if (!strcmp(name, policy_names[i]))
+            return i;
+    return -1;
+}
+
+static cshard_t *shard_of(unsigned h) {
+    return shards[shard_bits ? (h * 0x9E3779B1u) >> (32 - shard_bits) : 0];
+}
+
+static unsigned long now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+/* now_ms - last_use 에 쓰는 거친 시각 (밀리초) */
+static unsigned long now_ms(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return ts.tv_sec * 1000UL + ts.tv_nsec / 1000000;
+}
+
+/* shard_lock - 쓰는 쪽 잠금을 잡고, 바로 못 잡았으면 기다린 시간을 셈 */
+static void shard_lock(cshard_t *sh) {
+    unsigned long t0;
+
+    if (pthread_mutex_trylock(&sh->lock) == 0)
+        return;
+    t0 = now_ns();
+    pthread_mutex_lock(&sh->lock);
+    sh->nwaits++;
+    sh->wait_ns += now_ns() - t0;
+}
+
+static int stripe_index(void) {
+    if (my_stripe < 0)
+        my_stripe = __atomic_fetch_add(&next_stripe, 1, __ATOMIC_RELAXED) % CACHE_STRIPES;
+    return my_stripe;
+}
+
+static cstripe_t *my_counters(cshard_t *sh) {
+    return &sh->stripes[stripe_index()];
+}
+
+/*
+ * cache_init - 캐시를 n 개의 샤드로 만듦
+ *
+ * n 이 0이면 샤드 하나의 용량이 객체 최대 크기의 4배 이상이 되도록
+ * (최대 CACHE_MAX_SHARDS 개) 정한다. n 은 2의 거듭제곱으로 내림한다.
+ * topo_init 뒤에 불러야 샤드가 워커들의 노드에 나뉜다.
+ */
+void cache_init(size_t cache_size, size_t object_size, int n, int pol) {
+    size_t want;
+    int i;
+
+    max_cache = cache_size;
+    max_object = object_size;
+    policy = pol;
+    if (n <= 0)
+        for (n = 1; n < CACHE_MAX_SHARDS && cache_size / (2 * n) >= 4 * object_size; n *= 2)
+            ;
+    for (nshards = 1, shard_bits = 0; nshards * 2 <= n; nshards *= 2)
+        shard_bits++;
+    if (max_cache / nshards < max_object)
+        fprintf(stderr, "warning: cache shard size %zu is smaller than max object %zu\n",
+                max_cache / nshards, max_object);
+
+    shards = Calloc(nshards, sizeof(cshard_t *));
+    want = max_cache / nshards / CACHE_AVG_OBJECT;
+    for (i = 0; i < nshards; i++) {
+        /* topo_alloc_local 은 0 으로 채운 페이지를 돌려줌 (-c 가 없으면 노드를 정하지 않음) */
+        cshard_t *sh = shards[i] = topo_alloc_local(sizeof(cshard_t), topo_cpu(i));
+        pthread_mutex_init(&sh->lock, NULL);
+        sh->budget = max_cache / nshards;
+        sh->nbuckets = CACHE_MIN_BUCKETS;
+        while (sh->nbuckets < want && sh->nbuckets < CACHE_MAX_BUCKETS)
+            sh->nbuckets <<= 1;
+        sh->buckets = topo_alloc_local(sh->nbuckets * sizeof(cobj_t *), topo_cpu(i));
+        if (policy == CACHE_TINYLFU)
+            sketch_init(&sh->sk, want);
+    }
+}
+
+size_t cache_max_object(void) {
+    return max_object;
+}
+
+static void obj_free(cobj_t *obj) {
+    Free(obj->key);
+    Free(obj->data);
+    Free(obj->etag);
+    Free(obj->last_modified);
+    Free(obj->vary);
+    Free(obj->vkey);
+    Free(obj);
+}
+
+void cache_hold(cobj_t *obj) {
+    __atomic_add_fetch(&obj->refcnt, 1, __ATOMIC_RELAXED);
+}
+
+void cache_release(cobj_t *obj) {
+    if (__atomic_sub_fetch(&obj->refcnt, 1, __ATOMIC_ACQ_REL) == 0)
+        obj_free(obj);
+}
+
+/* 체인에서 빠진 객체의 캐시 참조를 놓음 (epoch_retire 콜백) */
+static void retire_release(void *p) {
+    cache_release(p);
+}
+
+/*
+ * find_slot - key 를 가리키는 체인 링크를 찾음 (없으면 NULL)
+ *
+ * 읽기 구간 안이나 샤드 잠금을 잡고 호출. 링크는 쓰는 쪽이 release 로
+ * 바꾸므로 acquire 로 읽으면 링크가 가리키는 객체의 내용도 다 보인다.
+ */
+static cobj_t **find_slot(cshard_t *sh, const char *key, unsigned h) {
+    cobj_t **pp = &sh->buckets[h & (sh->nbuckets - 1)];
+    cobj_t *obj;
+
+    while ((obj = __atomic_load_n(pp, __ATOMIC_ACQUIRE)) != NULL) {
+        if (obj->hash == h && !strcmp(obj->key, key))
+            return pp;
+        pp = &obj->hnext;
+    }
+    return NULL;
+}
+
+/*
+ * pick_variant - 항목 ent 의 변형 가운데 요청 헤더에 맞는 것 (없으면 NULL)
+ *
+ * 읽기 구간 안에서 호출. Vary 가 없던 항목은 ent 그대로.
+ */
+static cobj_t *pick_variant(cobj_t *ent, const char *hdrs, size_t len) {
+    char vkey[VARY_MAX];
+    cobj_t *v;
+
+    if (!ent->vary)
+        return ent;
+    if (vary_key(ent->vary, hdrs, len, vkey, sizeof(vkey)) < 0)
+        return NULL;
+    if (!strcmp(ent->vkey, vkey))
+        return ent;
+    for (v = __atomic_load_n(&ent->variants, __ATOMIC_ACQUIRE); v;
+         v = __atomic_load_n(&v->vnext, __ATOMIC_ACQUIRE))
+        if (!strcmp(v->vkey, vkey))
+            return v;
+    return NULL;
+}
+
+/*
+ * find - uri 의 객체 (Vary 가 있었으면 hdrs 에 맞는 변형) 를 찾아 참조를 늘려 돌려줌
+ *
+ * counted 면 적중/미스와 정책이 쓰는 빈도에 이 조회를 반영한다. 빈도와
+ * 마지막 사용 시각은 변형이 아니라 항목에 센다.
+ */
+static cobj_t *find(const char *uri, const char *hdrs, size_t len, int counted) {
+    char key[strlen(uri) + 2];
+    unsigned h;
+    unsigned long t;
+    cshard_t *sh;
+    cobj_t **pp, *ent, *obj = NULL;
+    cstripe_t *cnt;
+
+    cache_key(uri, key);
+    h = hash_key(key);
+    sh = shard_of(h);
+    cnt = my_counters(sh);
+
+    epoch_enter();
+    if ((pp = find_slot(sh, key, h)) != NULL) {
+        ent = __atomic_load_n(pp, __ATOMIC_ACQUIRE);
+        if ((obj = pick_variant(ent, hdrs, len)) != NULL)
+            __atomic_add_fetch(&obj->refcnt, 1, __ATOMIC_RELAXED);
+        if (counted && policy == CACHE_GDSF)
+            __atomic_add_fetch(&ent->freq, 1, __ATOMIC_RELAXED);
+        t = now_ms();
+        if (__atomic_load_n(&ent->last_use, __ATOMIC_RELAXED) != t)
+            __atomic_store_n(&ent->last_use, t, __ATOMIC_RELAXED);
+    }
+    epoch_exit();
+
+    if (!counted)
+        return obj;
+    if (policy == CACHE_TINYLFU)
+        sketch_add(&sh->sk, h);
+    if (obj && (cache_fresh(obj) || cache_stale_ok(obj))) {
+        __atomic_add_fetch(&cnt->hits, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&cnt->hit_bytes, obj->size, __ATOMIC_RELAXED);
+    } else if (obj) {
+        __atomic_add_fetch(&cnt->misses, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&cnt->stale, 1, __ATOMIC_RELAXED);
+    } else
+        __atomic_add_fetch(&cnt->misses, 1, __ATOMIC_RELAXED);
+    return obj;
+}
+
+cobj_t *cache_lookup(const char *uri, const char *hdrs, size_t len) {
+    return find(uri, hdrs, len, 1);
+}
+
+cobj_t *cache_peek(const char *uri, const char *hdrs, size_t len) {
+    return find(uri, hdrs, len, 0);
+}
+
+int cache_vary(const char *uri, char *out, size_t size) {
+    char key[strlen(uri) + 2];
+    unsigned h;
+    cobj_t **pp, *ent;
+    int found = -1;
+
+    cache_key(uri, key);
+    h = hash_key(key);
+    epoch_enter();
+    if ((pp = find_slot(shard_of(h), key, h)) != NULL) {
+        ent = __atomic_load_n(pp, __ATOMIC_ACQUIRE);
+        found = ent->vary && strlen(ent->vary) < size;
+        if (found)
+            strcpy(out, ent->vary);
+    }
+    epoch_exit();
+    return found;
+}
+
+int cache_fresh(cobj_t *obj) {
+    return time(NULL) < __atomic_load_n(&obj->expires, __ATOMIC_RELAXED);
+}
+
+int cache_stale_ok(cobj_t *obj) {
+    return time(NULL) < __atomic_load_n(&obj->expires, __ATOMIC_RELAXED) + obj->swr;
+}
+
+int cache_error_ok(cobj_t *obj) {
+    return time(NULL) < __atomic_load_n(&obj->expires, __ATOMIC_RELAXED) + obj->sie;
+}
+
+long cache_age(cobj_t *obj) {
+    return time(NULL) - __atomic_load_n(&obj->date, __ATOMIC_RELAXED);
+}
+
+void cache_refresh(cobj_t *obj, time_t expires) {
+    __atomic_store_n(&obj->date, time(NULL), __ATOMIC_RELAXED);
+    __atomic_store_n(&obj->expires, expires, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&nrefreshed, 1, __ATOMIC_RELAXED);
+}
+
+/* dup_str - NULL 이면 NULL, 아니면 복사 */
+static char *dup_str(const char *s) {
+    char *p;
+
+    if (!s)
+        return NULL;
+    p = Malloc(strlen(s) + 1);
+    strcpy(p, s);
+    return p;
+}
+
+void cache_count_miss(size_t bytes) {
+    __atomic_add_fetch(&byte_stripes[stripe_index()].miss_bytes, bytes, __ATOMIC_RELAXED);
+}
+
+/* 아래 함수들은 샤드 잠금을 잡고 호출 */
+
+static void lru_unlink(cshard_t *sh, cobj_t *obj) {
+    if (obj->prev)
+        obj->prev->next = obj->next;
+    else
+        sh->lru_head = obj->next;
+    if (obj->next)
+        obj->next->prev = obj->prev;
+    else
+        sh->lru_tail = obj->prev;
+}
+
+static void lru_push_front(cshard_t *sh, cobj_t *obj) {
+    obj->prev = NULL;
+    obj->next = sh->lru_head;
+    if (sh->lru_head)
+        sh->lru_head->prev = obj;
+    else
+        sh->lru_tail = obj;
+    sh->lru_head = obj;
+    obj->lru_stamp = __atomic_load_n(&obj->last_use, __ATOMIC_RELAXED);
+}
+
+/* gdsf_prio - L 에서 출발해 freq 번 요청된 객체의 우선순위 */
+static double gdsf_prio(cshard_t *sh, cobj_t *obj, unsigned long freq) {
+    obj->prio_freq = freq;
+    return sh->clock + freq * GDSF_COST / (obj->charge + obj->vcharge);
+}
+
+static void heap_set(cshard_t *sh, int i, cobj_t *obj) {
+    sh->heap[i] = obj;
+    obj->heap_idx = i;
+}
+
+static void heap_up(cshard_t *sh, int i) {
+    cobj_t *obj = sh->heap[i];
+
+    while (i > 0 && sh->heap[(i - 1) / 2]->prio > obj->prio) {
+        heap_set(sh, i, sh->heap[(i - 1) / 2]);
+        i = (i - 1) / 2;
+    }
+    heap_set(sh, i, obj);
+}
+
+static void heap_down(cshard_t *sh, int i) {
+    cobj_t *obj = sh->heap[i];
+    int c;
+
+    while ((c = 2 * i + 1) < sh->heap_len) {
+        if (c + 1 < sh->heap_len && sh->heap[c + 1]->prio < sh->heap[c]->prio)
+            c++;
+        if (sh->heap[c]->prio >= obj->prio)
+            break;
+        heap_set(sh, i, sh->heap[c]);
+        i = c;
+    }
+    heap_set(sh, i, obj);
+}
+
+static void heap_push(cshard_t *sh, cobj_t *obj) {
+    if (sh->heap_len == sh->heap_cap) {
+        sh->heap_cap = sh->heap_cap ? 2 * sh->heap_cap : CACHE_MIN_BUCKETS;
+        sh->heap = Realloc(sh->heap, sh->heap_cap * sizeof(cobj_t *));
+    }
+    heap_set(sh, sh->heap_len++, obj);
+    heap_up(sh, obj->heap_idx);
+}
+
+static void heap_remove(cshard_t *sh, cobj_t *obj) {
+    int i = obj->heap_idx;
+    cobj_t *last = sh->heap[--sh->heap_len];
+
+    if (last == obj)
+        return;
+    heap_set(sh, i, last);
+    heap_up(sh, i);
+    heap_down(sh, last->heap_idx);
+}
+
+/* index_unlink / index_add - 정책이 쓰는 순서 (LRU 목록, gdsf 힙) 에서 빼고 넣음 */
+static void index_unlink(cshard_t *sh, cobj_t *obj) {
+    lru_unlink(sh, obj);
+    if (policy == CACHE_GDSF)
+        heap_remove(sh, obj);
+}
+
+static void index_add(cshard_t *sh, cobj_t *obj) {
+    lru_push_front(sh, obj);
+    if (policy == CACHE_GDSF) {
+        obj->prio = gdsf_prio(sh, obj, __atomic_load_n(&obj->freq, __ATOMIC_RELAXED));
+        heap_push(sh, obj);
+    }
+}
+
+/*
+ * drop_variants - 항목 ent 의 변형 목록에서 링크 pp 가 가리키는 변형부터 끝까지 뺌
+ *
+ * 목록을 따라가던 읽기를 위해 빠진 변형의 vnext 는 그대로 두고 epoch 로 회수한다.
+ */
+static void drop_variants(cshard_t *sh, cobj_t *ent, cobj_t **pp) {
+    cobj_t *v;
+
+    while ((v = *pp) != NULL) {
+        __atomic_store_n(pp, v->vnext, __ATOMIC_RELEASE);
+        ent->vcharge -= v->charge;
+        sh->used -= v->charge;
+        sh->nvariants--;
+        epoch_retire(retire_release, v);
+    }
+}
+
+/*
+ * unlink_obj - 해시 체인과 LRU 목록(gdsf 면 힙)에서 뺌 (변형들도 함께)
+ *
+ * 체인을 따라가던 읽기가 아직 obj 에 있을 수 있으므로 obj->hnext 는 그대로
+ * 두고, 캐시의 참조는 그런 읽기가 다 끝난 뒤 놓는다 (보내는 중이면 마지막
+ * 사용자가 해제).
+ */
+static void unlink_obj(cshard_t *sh, cobj_t *obj) {
+    cobj_t **pp = &sh->buckets[obj->hash & (sh->nbuckets - 1)];
+
+    while (*pp != obj)
+        pp = &(*pp)->hnext;
+    __atomic_store_n(pp, obj->hnext, __ATOMIC_RELEASE);
+    index_unlink(sh, obj);
+    sh->used -= obj->charge;
+    sh->nobjs--;
+    drop_variants(sh, obj, &obj->variants);
+    epoch_retire(retire_release, obj);
+}
+
+/*
+ * lru_victim - 다음에 내보낼 객체 (LRU 목록 끝)
+ *
+ * 끝의 객체가 지금 자리로 온 뒤 적중한 적이 있으면 앞으로 옮기고 다음 것을 본다.
+ */
+static cobj_t *lru_victim(cshard_t *sh) {
+    cobj_t *obj;
+
+    while ((obj = sh->lru_tail) != NULL &&
+           __atomic_load_n(&obj->last_use, __ATOMIC_RELAXED) != obj->lru_stamp) {
+        lru_unlink(sh, obj);
+        lru_push_front(sh, obj);
+    }
+    return obj;
+}
+
+/*
+ * gdsf_victim - 다음에 내보낼 객체 (힙 맨 위)
+ *
+ * 맨 위 객체가 prio 를 계산한 뒤 다시 요청됐으면 지금의 L 로 다시 계산해
+ * 내리고 다음 것을 본다.
+ */
+static cobj_t *gdsf_victim(cshard_t *sh) {
+    cobj_t *obj;
+    unsigned long f;
+
+    while (sh->heap_len > 0) {
+        obj = sh->heap[0];
+        if ((f = __atomic_load_n(&obj->freq, __ATOMIC_RELAXED)) == obj->prio_freq)
+            return obj;
+        obj->prio = gdsf_prio(sh, obj, f);
+        heap_down(sh, 0);
+    }
+    return NULL;
+}
+
+static cobj_t *victim_of(cshard_t *sh) {
+    return policy == CACHE_GDSF ? gdsf_victim(sh) : lru_victim(sh);
+}
+
+static void evict(cshard_t *sh, cobj_t *obj) {
+    if (policy == CACHE_GDSF)
+        sh->clock = obj->prio;      /* L 을 올려 남은 객체들이 늙게 함 */
+    unlink_obj(sh, obj);
+    sh->nevicts++;
+}
+
+/*
+ * make_room - 새 객체(해시 h)가 charge 바이트를 쓸 수 있게 내보냄
+ *
+ * tinylfu 면 내보낼 객체마다 새 객체와 추정 빈도를 비교해, 새 객체가 더
+ * 자주 쓰이지 않으면 멈추고 0을 돌려준다 (그때까지 진 객체들은 이미 나감).
+ * 반환값: 자리가 생겼으면 1
+ */
+static int make_room(cshard_t *sh, unsigned h, size_t charge) {
+    int freq = policy == CACHE_TINYLFU ? sketch_estimate(&sh->sk, h) : 0;
+    cobj_t *victim;
+
+    while (sh->used + charge > sh->budget) {
+        victim = victim_of(sh);
+        if (policy == CACHE_TINYLFU && sketch_estimate(&sh->sk, victim->hash) >= freq)
+            return 0;
+        evict(sh, victim);
+    }
+    return 1;
+}
+
+/*
+ * add_variant - 항목 ent 의 변형 목록에 obj 를 넣음 (같은 변형 키가 있으면 교체)
+ *
+ * 항목은 LRU 자리와 용량을 변형들과 함께 쓰므로, 자리를 비우는 동안은
+ * 정책 순서에서 빼 두어 자기 자신이 내보내지지 않게 한다. 변형이
+ * CACHE_MAX_VARIANTS 개를 넘으면 목록 끝의 (가장 오래된) 변형을 뺀다.
+ * 반환값: 넣었으면 1 (항목 전체가 샤드 용량을 넘으면 0)
+ */
+static int add_variant(cshard_t *sh, cobj_t *ent, cobj_t *obj) {
+    cobj_t **pp, *v;
+    size_t old_charge = 0;
+    int n = 1;                          /* ent 자신도 변형 하나 */
+
+    for (pp = &ent->variants; (v = *pp) != NULL && strcmp(v->vkey, obj->vkey); pp = &v->vnext)
+        n++;
+    if (v)
+        old_charge = v->charge;
+    if (ent->charge + ent->vcharge - old_charge + obj->charge > sh->budget)
+        return 0;
+
+    index_unlink(sh, ent);
+    if (v) {
+        obj->vnext = v->vnext;
+        __atomic_store_n(pp, obj, __ATOMIC_RELEASE);
+        ent->vcharge -= v->charge;
+        sh->used -= v->charge;
+        epoch_retire(retire_release, v);
+    } else {
+        obj->vnext = ent->variants;
+        __atomic_store_n(&ent->variants, obj, __ATOMIC_RELEASE);
+        sh->nvariants++;
+        if (n >= CACHE_MAX_VARIANTS) {
+            for (pp = &obj->vnext; *pp && (*pp)->vnext; pp = &(*pp)->vnext)
+                ;
+            drop_variants(sh, ent, pp);
+        }
+    }
+    ent->vcharge += obj->charge;
+    sh->used += obj->charge;
+    while (sh->used > sh->budget)
+        evict(sh, victim_of(sh));
+    index_add(sh, ent);
+    return 1;
+}
+
+void cache_insert(const char *uri, const char *data, size_t size, const cmeta_t *meta) {
+    char key[strlen(uri) + 2];
+    size_t keylen, charge;
+    unsigned h;
+    cshard_t *sh;
+    cobj_t *obj, *old, **pp;
+
+    cache_key(uri, key);
+    keylen = strlen(key) + 1;
+    charge = sizeof(cobj_t) + keylen + size;
+    if (meta->etag)
+        charge += strlen(meta->etag) + 1;
+    if (meta->last_modified)
+        charge += strlen(meta->last_modified) + 1;
+    if (meta->vary)
+        charge += strlen(meta->vary) + strlen(meta->vkey) + 2;
+    h = hash_key(key);
+    sh = shard_of(h);
+    if (size > max_object || charge > sh->budget)
+        return;
+
+    /* 복사는 잠금 밖에서 */
+    obj = Malloc(sizeof(cobj_t));
+    obj->key = Malloc(keylen);
+    memcpy(obj->key, key, keylen);
+    obj->data = Malloc(size);
+    memcpy(obj->data, data, size);
+    obj->size = size;
+    obj->etag = dup_str(meta->etag);
+    obj->last_modified = dup_str(meta->last_modified);
+    obj->vary = dup_str(meta->vary);
+    obj->vkey = meta->vary ? dup_str(meta->vkey) : NULL;
+    obj->variants = obj->vnext = NULL;
+    obj->vcharge = 0;
+    obj->expires = meta->expires;
+    obj->swr = meta->swr;
+    obj->sie = meta->sie;
+    obj->date = time(NULL);
+    obj->refreshing = 0;
+    obj->charge = charge;
+    obj->hash = h;
+    obj->refcnt = 1;
+    obj->freq = 1;
+    obj->last_use = now_ms();
+
+    shard_lock(sh);
+    pp = find_slot(sh, key, h);
+    if (pp && (old = *pp)->vary && obj->vary && !strcmp(old->vary, obj->vary) &&
+        strcmp(old->vkey, obj->vkey)) {
+        /* 같은 URI 의 다른 변형: 항목의 변형 목록에 넣음 */
+        if (!add_variant(sh, old, obj)) {
+            sh->nrejects++;
+            pthread_mutex_unlock(&sh->lock);
+            obj_free(obj);
+            return;
+        }
+        sh->ninserts++;
+        pthread_mutex_unlock(&sh->lock);
+        return;
+    }
+    if (pp) {
+        /* 새 응답으로 교체: 같은 자리에 바꿔 끼워서 읽는 쪽은 옛것이나
+         * 새것 중 하나를 보고, 그 사이에 키가 없어 보이는 순간이 없음.
+         * Vary 목록이 같으면 다른 변형들은 새 객체로 옮기고, 다르면 버림 */
+        old = *pp;
+        index_unlink(sh, old);
+        obj->freq = __atomic_load_n(&old->freq, __ATOMIC_RELAXED);  /* 새 응답도 빈도는 이어받음 */
+        sh->used -= old->charge;
+        sh->nobjs--;
+        if (old->vary && obj->vary && !strcmp(old->vary, obj->vary) &&
+            charge + old->vcharge <= sh->budget) {
+            obj->variants = old->variants;
+            obj->vcharge = old->vcharge;
+        } else {
+            drop_variants(sh, old, &old->variants);
+        }
+        while (sh->used + charge > sh->budget)   /* 이미 있던 키는 빈도와 상관없이 받음 */
+            evict(sh, victim_of(sh));
+        if ((pp = find_slot(sh, key, h)) == NULL)   /* 다시 찾음 (evict 로 체인이 바뀜) */
+            app_error("cache: replaced object vanished");
+        obj->hnext = old->hnext;
+        __atomic_store_n(pp, obj, __ATOMIC_RELEASE);
+        epoch_retire(retire_release, old);
+    } else {
+        if (!make_room(sh, h, charge)) {
+            sh->nrejects++;
+            pthread_mutex_unlock(&sh->lock);
+            obj_free(obj);
+            return;
+        }
+        obj->hnext = sh->buckets[h & (sh->nbuckets - 1)];
+        __atomic_store_n(&sh->buckets[h & (sh->nbuckets - 1)], obj, __ATOMIC_RELEASE);
+    }
+    index_add(sh, obj);
+    sh->used += charge;
+    sh->nobjs++;
+    sh->ninserts++;
+    pthread_mutex_unlock(&sh->lock);
+}
+
+/* shard_counts - 칸별 적중/미스 카운터를 합침 */
+static void shard_counts(cshard_t *sh, unsigned long *hits, unsigned long *misses) {
+    int i;
+
+    *hits = *misses = 0;
+    for (i = 0; i < CACHE_STRIPES; i++) {
+        *hits += __atomic_load_n(&sh->stripes[i].hits, __ATOMIC_RELAXED);
+        *misses += __atomic_load_n(&sh->stripes[i].misses, __ATOMIC_RELAXED);
+    }
+}
+
+/* stripe_bytes - 칸별 적중/미스 바이트를 합침 */
+static void stripe_bytes(cstripe_t *st, unsigned long *hit_bytes, unsigned long *miss_bytes) {
+    int i;
+
+    for (i = 0; i < CACHE_STRIPES; i++) {
+        *hit_bytes += __atomic_load_n(&st[i].hit_bytes, __ATOMIC_RELAXED);
+        *miss_bytes += __atomic_load_n(&st[i].miss_bytes, __ATOMIC_RELAXED);
+    }
+}
+
+/*
+ * cache_stats - 전체 적중률(요청, 바이트 기준), 재검증 수와 사용량, 정책이 거절한 객체 수, 샤드별 적중률과 잠금 대기 시간 출력
+ *
+ * 통계는 잠금 없이 읽으므로 근사치다 (출력이 샤드를 기다리게 하지 않음).
+ * epoch 회수 상태도 함께 출력한다.
+ */
+void cache_stats(FILE *fp) {
+    unsigned long hits = 0, misses = 0, inserts = 0, evicts = 0, rejects = 0, h, m, w;
+    unsigned long hit_bytes = 0, miss_bytes = 0, stale = 0;
+    size_t used = 0;
+    int i, j, nobjs = 0, nvariants = 0;
+
+    for (i = 0; i < nshards; i++) {
+        cshard_t *sh = shards[i];
+        shard_counts(sh, &h, &m);
+        stripe_bytes(sh->stripes, &hit_bytes, &miss_bytes);
+        for (j = 0; j < CACHE_STRIPES; j++)
+            stale += __atomic_load_n(&sh->stripes[j].stale, __ATOMIC_RELAXED);
+        hits += h;
+        misses += m;
+        inserts += __atomic_load_n(&sh->ninserts, __ATOMIC_RELAXED);
+        evicts += __atomic_load_n(&sh->nevicts, __ATOMIC_RELAXED);
+        rejects += __atomic_load_n(&sh->nrejects, __ATOMIC_RELAXED);
+        used += __atomic_load_n(&sh->used, __ATOMIC_RELAXED);
+        nobjs += __atomic_load_n(&sh->nobjs, __ATOMIC_RELAXED);
+        nvariants += __atomic_load_n(&sh->nvariants, __ATOMIC_RELAXED);
+    }
+    stripe_bytes(byte_stripes, &hit_bytes, &miss_bytes);
+    fprintf(fp, "cache: %d objects (+%d variants) %zu/%zu bytes hits %lu misses %lu (%.1f%%) "
+                "bytes hit %lu missed %lu (%.1f%%) stale %lu refreshed %lu "
+                "inserts %lu evictions %lu rejected %lu shards %d policy %s\n",
+            nobjs, nvariants, used, max_cache, hits, misses,
+            hits + misses ? 100.0 * hits / (hits + misses) : 0.0,
+            hit_bytes, miss_bytes,
+            hit_bytes + miss_bytes ? 100.0 * hit_bytes / (hit_bytes + miss_bytes) : 0.0,
+            stale, __atomic_load_n(&nrefreshed, __ATOMIC_RELAXED), inserts, evicts, rejects, nshards, policy_names[policy]);
+    for (i = 0; i < nshards; i++) {
+        cshard_t *sh = shards[i];
+        shard_counts(sh, &h, &m);
+        w = __atomic_load_n(&sh->nwaits, __ATOMIC_RELAXED);
+        fprintf(fp, "cache shard %d: %d objects %zu/%zu bytes hit %.1f%% (%lu/%lu) "
+                    "lock waits %lu avg %luns\n",
+                i, __atomic_load_n(&sh->nobjs, __ATOMIC_RELAXED),
+                __atomic_load_n(&sh->used, __ATOMIC_RELAXED), sh->budget,
+                h + m ? 100.0 * h / (h + m) : 0.0, h, h + m,
+                w, w ? __atomic_load_n(&sh->wait_ns, __ATOMIC_RELAXED) / w : 0);
+    }
+    epoch_stats(fp);
+}
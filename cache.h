@@ -0,0 +1,110 @@
+/*
+ * cache.h - 웹 객체 캐시 (샤딩, LRU / TinyLFU / GDSF 정책)
+ */
+#ifndef __CACHE_H__
+#define __CACHE_H__
+
+#include <stdio.h>
+#include <stddef.h>
+#include <time.h>
+
+/* 캐시된 응답 하나 (서버가 보낸 헤더와 본문 그대로). 들어간 뒤에는 바뀌지 않음
+ * (변형 목록과 charge 는 쓰는 쪽이 샤드 잠금을 잡고 바꿈) */
+typedef struct cobj {
+    char *key;                  /* 정규화한 요청 URI */
+    char *vary;                 /* 정규화한 Vary 이름 목록 (없으면 NULL) */
+    char *vkey;                 /* 이 변형을 고르는 요청 헤더 값들 (vary.c, vary 가 없으면 NULL) */
+    struct cobj *variants;      /* 해시 체인에 걸린 객체: 같은 URI 의 다른 변형들 (잠금 없이 읽힘) */
+    struct cobj *vnext;         /* 변형 목록 링크 */
+    size_t vcharge;             /* 해시 체인에 걸린 객체: 다른 변형들의 charge 합 */
+    char *data;
+    size_t size;                /* data 바이트 수 */
+    char *etag;                 /* 재검증에 쓸 검증자 (없으면 NULL) */
+    char *last_modified;
+    time_t expires;             /* 이 시각까지 신선 (304 로 재검증되면 원자적으로 늘어남) */
+    long swr;                   /* 만료 뒤 재검증하는 동안 그대로 보내도 되는 기간 (초) */
+    long sie;                   /* 만료 뒤 서버가 실패하면 대신 보내도 되는 기간 (초) */
+    time_t date;                /* 서버에서 받거나 마지막으로 재검증한 시각 (Age 계산) */
+    int refreshing;             /* 백그라운드 재검증이 걸려 있음 (refresh.c) */
+    size_t charge;              /* 캐시 용량에서 차지하는 바이트 (구조체, 키 포함) */
+    unsigned hash;
+    int refcnt;                 /* 캐시 자신 + 지금 보내고 있는 요청 수 */
+    unsigned long last_use;     /* 마지막 적중 시각 (밀리초, 잠금 없이 갱신) */
+    unsigned long lru_stamp;    /* LRU 목록에서 지금 자리로 옮겨진 시각 */
+    unsigned long freq;         /* gdsf: 들어온 뒤 요청 횟수 (잠금 없이 갱신) */
+    unsigned long prio_freq;    /* gdsf: prio 를 계산할 때의 freq */
+    double prio;                /* gdsf: 우선순위 (작을수록 먼저 나감) */
+    int heap_idx;               /* gdsf: 우선순위 큐에서의 위치 */
+    struct cobj *hnext;         /* 해시 체인 링크 (잠금 없이 읽힘) */
+    struct cobj *prev, *next;   /* LRU 목록 링크 (앞이 최근) */
+} cobj_t;
+
+/* cache_insert 에 넘기는 신선도와 검증자 (문자열은 복사됨, NULL 가능) */
+typedef struct {
+    time_t expires;
+    long swr;
+    long sie;
+    const char *etag;
+    const char *last_modified;
+    const char *vary;           /* 정규화한 Vary 이름 목록 (fresh.c) */
+    const char *vkey;           /* 이 응답을 받은 요청의 변형 키 (vary.c) */
+} cmeta_t;
+
+/* 교체 정책 (-E) */
+enum cache_policy {
+    CACHE_LRU,                  /* LRU 로 내보내고 모두 받아들임 */
+    CACHE_TINYLFU,              /* 내보낼 객체보다 자주 쓰일 때만 받아들임 */
+    CACHE_GDSF                  /* 빈도 x 비용 / 크기가 가장 작은 것부터 내보냄 */
+};
+
+/* 정책 이름("lru", "tinylfu", "gdsf")을 enum cache_policy 로 (모르면 -1) */
+int cache_policy(const char *name);
+
+/* uri 를 정규화한 캐시 키 (out 은 strlen(uri) + 2 바이트 이상) */
+void cache_key(const char *uri, char *out);
+
+/* nshards 는 2의 거듭제곱으로 내림 (0이면 용량에 맞춰 자동) */
+void cache_init(size_t max_cache, size_t max_object, int nshards, int policy);
+size_t cache_max_object(void);
+
+/* uri 의 객체를 찾아 참조를 하나 늘려 돌려줌 (없으면 NULL).
+ * 응답에 Vary 가 있었으면 요청 헤더들 hdrs (len 바이트, NULL 가능) 에 맞는 변형을 고름.
+ * 신선하지 않은 객체도 돌려주므로 cache_fresh 로 확인해야 함.
+ * 다 쓰면 cache_release 로 돌려줘야 함 */
+cobj_t *cache_lookup(const char *uri, const char *hdrs, size_t len);
+/* cache_lookup 과 같지만 적중률과 정책의 빈도에 반영하지 않음 (다시 확인할 때) */
+cobj_t *cache_peek(const char *uri, const char *hdrs, size_t len);
+
+/* uri 의 캐시된 응답에 Vary 가 있었으면 그 이름 목록을 out 에 복사하고 1,
+ * Vary 가 없었으면 0, 캐시에 없으면 -1 */
+int cache_vary(const char *uri, char *out, size_t size);
+void cache_release(cobj_t *obj);
+
+/* 이미 가진 참조를 하나 더 늘림 (다른 스레드에 넘길 때) */
+void cache_hold(cobj_t *obj);
+
+/* 지금 신선한지 */
+int cache_fresh(cobj_t *obj);
+
+/* 만료됐지만 재검증 유예 기간 (stale-while-revalidate) 안이라 그대로 보내도 되는지 */
+int cache_stale_ok(cobj_t *obj);
+
+/* 만료됐지만 서버가 실패했을 때 대신 보내도 되는 기간 (stale-if-error) 안인지 */
+int cache_error_ok(cobj_t *obj);
+
+/* 서버에서 받거나 재검증한 뒤 지난 초 (Age 헤더) */
+long cache_age(cobj_t *obj);
+
+/* 304 로 재검증된 객체의 신선 기간을 늘림 */
+void cache_refresh(cobj_t *obj, time_t expires);
+
+/* 캐시에서 보내지 못하고 서버에서 받아 보낸 응답 바이트 (바이트 적중률용) */
+void cache_count_miss(size_t bytes);
+
+/* data 를 복사해 uri 로 넣음 (max_object 보다 크면 무시, 이미 있으면 교체).
+ * 같은 Vary 목록의 다른 변형이 있으면 그 옆에 변형으로 넣음 */
+void cache_insert(const char *uri, const char *data, size_t size, const cmeta_t *meta);
+
+void cache_stats(FILE *fp);
+
+#endif /* __CACHE_H__ */
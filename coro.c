@@ -0,0 +1,259 @@
+/*
+ * coro.c - 스택형 코루틴 런타임 (-m coro)
+ *
+ * 연결마다 코루틴 하나를 만들어 doit 을 그대로(순차적인 코드 그대로)
+ * 실행한다. 소켓은 논블로킹이며, Rio_readlineb/Rio_writen/open_clientfd 가
+ * EAGAIN 을 만나면 csapp 의 io_wait_hook 을 통해 coro_wait 가 불리고,
+ * 코루틴은 epoll 스케줄러로 양보했다가 소켓이 준비되면 이어서 실행된다.
+ *
+ * 스케줄러는 OS 스레드마다 하나씩 있고, 코루틴은 만들어진 스레드에서만
+ * 실행된다(스레드 간 이동 없음). 코루틴 스택은 mmap 으로 CORO_STACK_SIZE
+ * 만큼 주소 공간만 예약하고(MAP_NORESERVE), 실제 메모리는 스택이 닿는
+ * 페이지만큼만 커널이 채워 주므로 필요한 만큼 자란다. 맨 아래 한 페이지는
+ * 넘침을 잡는 보호 페이지다. 다 쓴 스택은 스레드별 목록에 모아 재사용한다.
+ *
+ * 주의: 호스트 이름 해석(getaddrinfo)은 여전히 스레드를 블로킹한다.
+ */
+#define _GNU_SOURCE
+#include "proxy.h"
+#include "coro.h"
+#include "admit.h"
+#include <ucontext.h>
+#include <sys/epoll.h>
+
+#define CORO_STACK_SIZE  (256 * 1024)   /* 코루틴 하나가 예약하는 스택 주소 공간 */
+#define CORO_MAX_EVENTS  256
+#define CORO_STACK_CACHE 1024           /* 스레드별로 보관하는 재사용 스택 수 */
+
+typedef struct coro {
+    ucontext_t ctx;
+    char *stack;                /* mmap 으로 예약한 영역 (맨 아래는 보호 페이지) */
+    int fd;                     /* 처리할 연결 소켓 (accept 코루틴이면 리스닝 소켓) */
+    void (*fn)(struct coro *);
+    int done;
+    struct coro *next;          /* 실행 대기열 / 재사용 목록 링크 */
+} coro_t;
+
+/* 스케줄러: 스레드마다 하나 */
+typedef struct {
+    int epfd;
+    ucontext_t ctx;             /* 스케줄러 자신의 문맥 */
+    coro_t *current;            /* 지금 실행 중인 코루틴 */
+    coro_t *runq_head, *runq_tail;
+    coro_t *free_stacks;        /* 재사용할 스택을 가진 코루틴 구조체 */
+    int nfree;
+    int cpu;
+    int listenfd;
+} sched_t;
+
+static __thread sched_t *sched;
+
+static size_t page_size;
+
+/*
+ * runq_push - 코루틴을 실행 대기열 끝에 추가
+ */
+static void runq_push(coro_t *co) {
+    co->next = NULL;
+    if (sched->runq_tail)
+        sched->runq_tail->next = co;
+    else
+        sched->runq_head = co;
+    sched->runq_tail = co;
+}
+
+static coro_t *runq_pop(void) {
+    coro_t *co = sched->runq_head;
+
+    if (co) {
+        sched->runq_head = co->next;
+        if (!sched->runq_head)
+            sched->runq_tail = NULL;
+    }
+    return co;
+}
+
+/*
+ * coro_wait - 현재 코루틴을 fd 가 준비될 때까지 재우고 스케줄러로 양보
+ *
+ * csapp 의 io_wait_hook 으로 등록되어 Rio 함수와 open_clientfd 에서 불린다.
+ * EPOLLONESHOT 으로 등록하므로 한 번 깨어나면 다시 등록할 때까지 조용하다.
+ * 반환값: 준비되면 0, 코루틴 밖에서 불렸거나 등록 실패 시 -1
+ */
+static int coro_wait(int fd, int events) {
+    struct epoll_event ev;
+    coro_t *co = sched ? sched->current : NULL;
+
+    if (!co)
+        return -1;
+    ev.events = EPOLLONESHOT | (events & IO_WAIT_READ ? EPOLLIN : 0) |
+                (events & IO_WAIT_WRITE ? EPOLLOUT : 0);
+    ev.data.ptr = co;
+    if (epoll_ctl(sched->epfd, EPOLL_CTL_MOD, fd, &ev) < 0) {
+        if (errno != ENOENT || epoll_ctl(sched->epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+            return -1;
+    }
+    swapcontext(&co->ctx, &sched->ctx);
+    return 0;
+}
+
+/*
+ * coro_entry - 코루틴의 시작 함수 (makecontext 는 포인터 인수를 넘기기
+ * 어려우므로 스케줄러의 current 에서 자신을 찾는다)
+ */
+static void coro_entry(void) {
+    coro_t *co = sched->current;
+
+    co->fn(co);
+    co->done = 1;               /* uc_link 를 따라 스케줄러로 돌아감 */
+}
+
+/*
+ * coro_spawn - fn(co) 를 실행할 코루틴을 만들어 실행 대기열에 넣음
+ */
+static void coro_spawn(void (*fn)(coro_t *), int fd) {
+    coro_t *co = sched->free_stacks;
+
+    if (co) {
+        sched->free_stacks = co->next;
+        sched->nfree--;
+    } else {
+        co = Malloc(sizeof(coro_t));
+        co->stack = mmap(NULL, CORO_STACK_SIZE, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (co->stack == MAP_FAILED)
+            unix_error("coroutine stack mmap error");
+        if (mprotect(co->stack, page_size, PROT_NONE) < 0)  /* 보호 페이지 */
+            unix_error("mprotect error");
+    }
+    co->fd = fd;
+    co->fn = fn;
+    co->done = 0;
+
+    getcontext(&co->ctx);
+    co->ctx.uc_stack.ss_sp = co->stack + page_size;
+    co->ctx.uc_stack.ss_size = CORO_STACK_SIZE - page_size;
+    co->ctx.uc_link = &sched->ctx;
+    makecontext(&co->ctx, coro_entry, 0);
+    runq_push(co);
+}
+
+/*
+ * coro_release - 끝난 코루틴의 스택을 재사용 목록에 반납 (넘치면 해제)
+ */
+static void coro_release(coro_t *co) {
+    if (sched->nfree < CORO_STACK_CACHE) {
+        co->next = sched->free_stacks;
+        sched->free_stacks = co;
+        sched->nfree++;
+        return;
+    }
+    munmap(co->stack, CORO_STACK_SIZE);
+    Free(co);
+}
+
+/*
+ * conn_coro - 연결 하나를 처리하는 코루틴 (thread_routine 과 같은 일)
+ */
+static void conn_coro(coro_t *co) {
+    admit_begin();
+    doit(co->fd);
+    Close(co->fd);
+    admit_end();
+}
+
+/*
+ * accept_coro - 연결을 받아 연결마다 코루틴을 만드는 코루틴
+ */
+static void accept_coro(coro_t *co) {
+    struct sockaddr_storage clientaddr;
+    socklen_t clientlen;
+    int fd;
+
+    while (1) {
+        clientlen = sizeof(clientaddr);
+        fd = accept4(co->fd, (SA *)&clientaddr, &clientlen, SOCK_NONBLOCK);
+        if (fd >= 0) {
+            if (admit_accept(fd))   /* 한도 초과면 503 을 보내고 이미 닫힘 */
+                coro_spawn(conn_coro, fd);
+            continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            coro_wait(co->fd, IO_WAIT_READ);
+        else if (errno != EINTR)
+            fprintf(stderr, "accept error: %s\n", strerror(errno));
+    }
+}
+
+/*
+ * sched_thread - 스케줄러 스레드: 실행 대기열을 비운 뒤 epoll 로 다음 이벤트를 기다림
+ */
+static void *sched_thread(void *vargp) {
+    struct epoll_event events[CORO_MAX_EVENTS];
+    coro_t *co;
+    int i, n;
+
+    sched = vargp;
+    pin_thread(sched->cpu);
+    if ((sched->epfd = epoll_create1(0)) < 0)
+        unix_error("epoll_create1 error");
+    io_wait_hook = coro_wait;
+    coro_spawn(accept_coro, sched->listenfd);
+
+    while (1) {
+        while ((co = runq_pop()) != NULL) {
+            sched->current = co;
+            swapcontext(&sched->ctx, &co->ctx);
+            sched->current = NULL;
+            if (co->done)
+                coro_release(co);
+        }
+
+        n = epoll_wait(sched->epfd, events, CORO_MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            unix_error("epoll_wait error");
+        }
+        for (i = 0; i < n; i++)
+            runq_push(events[i].data.ptr);
+    }
+    return NULL;
+}
+
+/*
+ * sched_new - listenfd 를 처리할 스케줄러를 만들고 리스닝 소켓을 논블로킹으로 설정
+ */
+static sched_t *sched_new(int listenfd, int cpu) {
+    sched_t *s = Calloc(1, sizeof(sched_t));
+
+    page_size = sysconf(_SC_PAGESIZE);
+    if (fcntl(listenfd, F_SETFL, fcntl(listenfd, F_GETFL, 0) | O_NONBLOCK) < 0)
+        unix_error("fcntl error");
+    s->listenfd = listenfd;
+    s->cpu = cpu;
+    return s;
+}
+
+/*
+ * coro_start - listenfd 를 처리하는 스케줄러 스레드 하나를 띄움
+ */
+void coro_start(int listenfd, int cpu) {
+    pthread_t tid;
+
+    topo_thread_create(&tid, sched_thread, sched_new(listenfd, cpu), cpu);
+    Pthread_detach(tid);
+}
+
+/*
+ * coro_run - nthreads 개의 스케줄러를 띄우고 첫 스케줄러는 호출한 스레드에서 실행
+ *
+ * -c 로 CPU 목록을 줬으면 스케줄러들을 그 CPU 에 차례로 고정한다.
+ */
+void coro_run(int listenfd, int nthreads) {
+    int i;
+
+    for (i = 1; i < nthreads; i++)
+        coro_start(listenfd, topo_cpu(i));
+    sched_thread(sched_new(listenfd, topo_cpu(0)));
+}
@@ -0,0 +1,13 @@
+/*
+ * coro.h - 스택형 코루틴 런타임 (-m coro)
+ */
+#ifndef __CORO_H__
+#define __CORO_H__
+
+/* nthreads 개의 스케줄러 스레드로 listenfd 의 연결을 처리 (반환하지 않음) */
+void coro_run(int listenfd, int nthreads);
+
+/* listenfd 를 처리하는 스케줄러 스레드 하나를 띄움 (cpu >= 0 이면 해당 CPU 에 고정) */
+void coro_start(int listenfd, int cpu);
+
+#endif /* __CORO_H__ */
@@ -23,6 +23,7 @@
  */
 /* $begin csapp.c */
 #include "csapp.h"
+#include <poll.h>
 
 /************************** 
  * Error-handling functions
@@ -738,6 +739,20 @@ void V(sem_t *sem)
 	unix_error("V error");
 }
 
+/*
+ * io_wait_hook - Per-thread hook for cooperative I/O. When set, the Rio
+ *     functions and open_clientfd call it instead of failing when a
+ *     non-blocking descriptor would block. It returns 0 once fd is
+ *     ready (the caller then retries) and -1 on error.
+ */
+__thread io_wait_t *io_wait_hook = NULL;
+
+static int io_would_block(int fd, int events)
+{
+    return (errno == EAGAIN || errno == EWOULDBLOCK) &&
+	io_wait_hook && io_wait_hook(fd, events) == 0;
+}
+
 /****************************************
  * The Rio package - Robust I/O functions
  ****************************************/
@@ -756,6 +771,8 @@ ssize_t rio_readn(int fd, void *usrbuf, size_t n)
 	if ((nread = read(fd, bufp, nleft)) < 0) {
 	    if (errno == EINTR) /* Interrupted by sig handler return */
 		nread = 0;      /* and call read() again */
+	    else if (io_would_block(fd, IO_WAIT_READ))
+		nread = 0;      /* Hook waited until readable */
 	    else
 		return -1;      /* errno set by read() */ 
 	} 
@@ -782,6 +799,8 @@ ssize_t rio_writen(int fd, void *usrbuf, size_t n)
 	if ((nwritten = write(fd, bufp, nleft)) <= 0) {
 	    if (errno == EINTR)  /* Interrupted by sig handler return */
 		nwritten = 0;    /* and call write() again */
+	    else if (io_would_block(fd, IO_WAIT_WRITE))
+		nwritten = 0;    /* Hook waited until writable */
 	    else
 		return -1;       /* errno set by write() */
 	}
@@ -810,7 +829,8 @@ static ssize_t rio_read(rio_t *rp, char *usrbuf, size_t n)
 	rp->rio_cnt = read(rp->rio_fd, rp->rio_buf, 
 			   sizeof(rp->rio_buf));
 	if (rp->rio_cnt < 0) {
-	    if (errno != EINTR) /* Interrupted by sig handler return */
+	    if (errno != EINTR && /* Interrupted by sig handler return */
+		!io_would_block(rp->rio_fd, IO_WAIT_READ))
 		return -1;
 	}
 	else if (rp->rio_cnt == 0)  /* EOF */
@@ -842,6 +862,16 @@ void rio_readinitb(rio_t *rp, int fd)
 }
 /* $end rio_readinitb */
 
+/*
+ * rio_readsomeb - Read up to n bytes (buffered), returning as soon as
+ *     any are available. Unlike rio_readnb it does not wait for n bytes,
+ *     so callers can relay a stream chunk by chunk as it arrives.
+ */
+ssize_t rio_readsomeb(rio_t *rp, void *usrbuf, size_t n)
+{
+    return rio_read(rp, usrbuf, n);
+}
+
 /*
  * rio_readnb - Robustly read n bytes (buffered)
  */
@@ -925,6 +955,15 @@ ssize_t Rio_readnb(rio_t *rp, void *usrbuf, size_t n)
     return rc;
 }
 
+ssize_t Rio_readsomeb(rio_t *rp, void *usrbuf, size_t n)
+{
+    ssize_t rc;
+
+    if ((rc = rio_readsomeb(rp, usrbuf, n)) < 0)
+	unix_error("Rio_readsomeb error");
+    return rc;
+}
+
 ssize_t Rio_readlineb(rio_t *rp, void *usrbuf, size_t maxlen) 
 {
     ssize_t rc;
@@ -948,8 +987,20 @@ ssize_t Rio_readlineb(rio_t *rp, void *usrbuf, size_t maxlen)
  */
 /* $begin open_clientfd */
 int open_clientfd(char *hostname, char *port) {
-    int clientfd, rc;
+    return open_clientfd_timeout(hostname, port, 0);
+}
+/* $end open_clientfd */
+
+/*
+ * open_clientfd_timeout - Like open_clientfd, but give up on each
+ *     address after timeout seconds instead of waiting out the kernel's
+ *     SYN retries (0 waits forever). The timeout is not applied under a
+ *     wait hook, where connect already yields instead of blocking.
+ */
+int open_clientfd_timeout(char *hostname, char *port, int timeout) {
+    int clientfd, rc, flags;
     struct addrinfo hints, *listp, *p;
+    struct pollfd pfd;
 
     /* Get a list of potential server addresses */
     memset(&hints, 0, sizeof(struct addrinfo));
@@ -967,9 +1018,37 @@ int open_clientfd(char *hostname, char *port) {
         if ((clientfd = socket(p->ai_family, p->ai_socktype, p->ai_protocol)) < 0) 
             continue; /* Socket failed, try the next */
 
+        /* Under a wait hook or with a timeout, connect without blocking the thread */
+        flags = fcntl(clientfd, F_GETFL, 0);
+        if (io_wait_hook || timeout > 0)
+            fcntl(clientfd, F_SETFL, flags | O_NONBLOCK);
+
         /* Connect to the server */
-        if (connect(clientfd, p->ai_addr, p->ai_addrlen) != -1) 
+        if (connect(clientfd, p->ai_addr, p->ai_addrlen) != -1) {
+            if (!io_wait_hook)
+                fcntl(clientfd, F_SETFL, flags);
             break; /* Success */
+        }
+        if (errno == EINPROGRESS && io_wait_hook &&
+            io_wait_hook(clientfd, IO_WAIT_WRITE) == 0) {
+            int err;
+            socklen_t errlen = sizeof(err);
+            if (getsockopt(clientfd, SOL_SOCKET, SO_ERROR, &err, &errlen) == 0 && err == 0)
+                break; /* Success */
+        } else if (errno == EINPROGRESS && !io_wait_hook && timeout > 0) {
+            int err;
+            socklen_t errlen = sizeof(err);
+            pfd.fd = clientfd;
+            pfd.events = POLLOUT;
+            while ((rc = poll(&pfd, 1, timeout * 1000)) < 0 && errno == EINTR)
+                ;
+            if (rc > 0 && getsockopt(clientfd, SOL_SOCKET, SO_ERROR, &err, &errlen) == 0 && err == 0) {
+                fcntl(clientfd, F_SETFL, flags);
+                break; /* Success */
+            }
+            if (rc == 0)
+                errno = ETIMEDOUT;
+        }
         if (close(clientfd) < 0) { /* Connect failed, try another */  //line:netp:openclientfd:closefd
             fprintf(stderr, "open_clientfd: close failed: %s\n", strerror(errno));
             return -1;
@@ -983,7 +1062,6 @@ int open_clientfd(char *hostname, char *port) {
     else    /* The last connect succeeded */
         return clientfd;
 }
-/* $end open_clientfd */
 
 /*  
  * open_listenfd - Open and return a listening socket on port. This
@@ -994,7 +1072,7 @@ int open_clientfd(char *hostname, char *port) {
  *       -1 with errno set for other errors.
  */
 /* $begin open_listenfd */
-int open_listenfd(char *port) 
+static int open_listenfd_opt(char *port, int reuseport)
 {
     struct addrinfo hints, *listp, *p;
     int listenfd, rc, optval=1;
@@ -1019,6 +1097,15 @@ int open_listenfd(char *port)
         setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR,    //line:netp:csapp:setsockopt
                    (const void *)&optval , sizeof(int));
 
+        /* Let several sockets bind the same port; the kernel spreads
+           incoming connections across them */
+        if (reuseport &&
+            setsockopt(listenfd, SOL_SOCKET, SO_REUSEPORT,
+                       (const void *)&optval, sizeof(int)) < 0) {
+            close(listenfd);
+            continue;
+        }
+
         /* Bind the descriptor to the address */
         if (bind(listenfd, p->ai_addr, p->ai_addrlen) == 0)
             break; /* Success */
@@ -1041,8 +1128,22 @@ int open_listenfd(char *port)
     }
     return listenfd;
 }
+
+int open_listenfd(char *port)
+{
+    return open_listenfd_opt(port, 0);
+}
 /* $end open_listenfd */
 
+/*
+ * open_listenfd_reuseport - Like open_listenfd, but sets SO_REUSEPORT so
+ *     that one listening socket per thread can share the same port.
+ */
+int open_listenfd_reuseport(char *port)
+{
+    return open_listenfd_opt(port, 1);
+}
+
 /****************************************************
  * Wrappers for reentrant protocol-independent helpers
  ****************************************************/
@@ -1064,6 +1165,15 @@ int Open_listenfd(char *port)
     return rc;
 }
 
+int Open_listenfd_reuseport(char *port)
+{
+    int rc;
+
+    if ((rc = open_listenfd_reuseport(port)) < 0)
+	unix_error("Open_listenfd_reuseport error");
+    return rc;
+}
+
 /* $end csapp.c */
 
 
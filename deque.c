@@ -0,0 +1,86 @@
+/*
+ * deque.c - Chase-Lev 작업 훔치기 덱 구현 (gcc __atomic 내장 함수 사용)
+ */
+#include "csapp.h"
+#include "deque.h"
+
+/* deque_init - capacity 를 2의 거듭제곱으로 올려서 빈 덱 생성 */
+void deque_init(deque_t *dq, int capacity) {
+    long n = 1;
+
+    while (n < capacity)
+        n <<= 1;
+    dq->top = dq->bottom = 0;
+    dq->buf = Calloc(n, sizeof(int));
+    dq->mask = n - 1;
+}
+
+/*
+ * deque_push - (주인 전용) 아래쪽에 항목 추가
+ * 반환값: 성공 0, 가득 차 있으면 -1
+ */
+int deque_push(deque_t *dq, int item) {
+    long b = __atomic_load_n(&dq->bottom, __ATOMIC_RELAXED);
+    long t = __atomic_load_n(&dq->top, __ATOMIC_ACQUIRE);
+
+    if (b - t > dq->mask)
+        return -1;
+    __atomic_store_n(&dq->buf[b & dq->mask], item, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&dq->bottom, b + 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+/*
+ * deque_take - (주인 전용) 아래쪽에서 가장 최근 항목을 꺼냄
+ * 반환값: 항목, 비어 있으면 DEQUE_EMPTY
+ */
+int deque_take(deque_t *dq) {
+    long b = __atomic_load_n(&dq->bottom, __ATOMIC_RELAXED) - 1;
+    long t;
+    int item;
+
+    __atomic_store_n(&dq->bottom, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    t = __atomic_load_n(&dq->top, __ATOMIC_RELAXED);
+
+    if (t > b) {                /* 비어 있음 */
+        __atomic_store_n(&dq->bottom, b + 1, __ATOMIC_RELAXED);
+        return DEQUE_EMPTY;
+    }
+    item = __atomic_load_n(&dq->buf[b & dq->mask], __ATOMIC_RELAXED);
+    if (t == b) {               /* 마지막 항목: 도둑과 경쟁 */
+        if (!__atomic_compare_exchange_n(&dq->top, &t, t + 1, 0,
+                                         __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+            item = DEQUE_EMPTY;
+        __atomic_store_n(&dq->bottom, b + 1, __ATOMIC_RELAXED);
+    }
+    return item;
+}
+
+/*
+ * deque_steal - (다른 워커) 위쪽에서 가장 오래된 항목을 훔침
+ * 반환값: 항목, DEQUE_EMPTY, 또는 경쟁에서 졌으면 DEQUE_ABORT
+ */
+int deque_steal(deque_t *dq) {
+    long t = __atomic_load_n(&dq->top, __ATOMIC_ACQUIRE);
+    long b;
+    int item;
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    b = __atomic_load_n(&dq->bottom, __ATOMIC_ACQUIRE);
+    if (t >= b)
+        return DEQUE_EMPTY;
+    item = __atomic_load_n(&dq->buf[t & dq->mask], __ATOMIC_RELAXED);
+    if (!__atomic_compare_exchange_n(&dq->top, &t, t + 1, 0,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+        return DEQUE_ABORT;
+    return item;
+}
+
+/* deque_size - 대략적인 항목 수 (통계용) */
+long deque_size(deque_t *dq) {
+    long n = __atomic_load_n(&dq->bottom, __ATOMIC_RELAXED) -
+             __atomic_load_n(&dq->top, __ATOMIC_RELAXED);
+    return n > 0 ? n : 0;
+}
@@ -0,0 +1,29 @@
+/*
+ * deque.h - 작업 훔치기용 Chase-Lev 덱 (락 없음)
+ *
+ * 주인 워커만 아래쪽(bottom)에서 넣고(push) 꺼내며(take), 다른 워커들은
+ * 위쪽(top)에서 훔친다(steal). 주인과 도둑이 마지막 항목 하나를 두고
+ * 경쟁할 때만 top 에 대한 CAS 가 필요하다. 항목은 연결 소켓(int)이다.
+ * (Lê et al., "Correct and Efficient Work-Stealing for Weak Memory Models")
+ */
+#ifndef __DEQUE_H__
+#define __DEQUE_H__
+
+#define DEQUE_EMPTY  -1     /* 꺼낼 항목이 없음 */
+#define DEQUE_ABORT  -2     /* 다른 도둑과의 경쟁에서 짐 (다시 시도 가능) */
+
+typedef struct {
+    long top;               /* 도둑들이 가져가는 쪽 */
+    char pad[64 - sizeof(long)];
+    long bottom;            /* 주인이 넣고 꺼내는 쪽 */
+    int *buf;               /* 크기가 2의 거듭제곱인 원형 배열 */
+    long mask;
+} deque_t;
+
+void deque_init(deque_t *dq, int capacity);
+int deque_push(deque_t *dq, int item);
+int deque_take(deque_t *dq);
+int deque_steal(deque_t *dq);
+long deque_size(deque_t *dq);
+
+#endif /* __DEQUE_H__ */
@@ -0,0 +1,159 @@
+/*
+ * epoch.c - epoch 기반 메모리 회수
+ *
+ * 잠금 없이 읽는 자료 구조에서 빼낸 노드를 언제 해제해도 되는지 판단한다.
+ *
+ * - 스레드마다 기록(ep_rec_t) 하나를 두고, 읽기 구간에 들어갈 때 지금의
+ *   전역 epoch 과 active 를 적는다. 읽는 쪽이 쓰는 공유 메모리는 자기
+ *   기록뿐이다.
+ * - 노드를 빼낸 쪽은 그때의 전역 epoch 을 붙여 회수 대기 목록에 넣는다.
+ * - 활성인 모든 스레드가 지금 epoch 에 들어와 있으면 전역 epoch 을 하나
+ *   올린다. 빼낸 뒤 epoch 이 두 번 올라갔으면 그 노드를 볼 수 있었던
+ *   읽기 구간은 모두 끝났으므로 해제한다.
+ *
+ * 기록은 스레드가 끝나면 재사용되므로, 연결마다 스레드를 만드는 thread
+ * 모드에서도 기록 수는 동시에 살아 있는 스레드 수를 넘지 않는다.
+ */
+#include "csapp.h"
+#include "epoch.h"
+
+typedef struct ep_rec {
+    unsigned long epoch;            /* 읽기 구간에 들어올 때의 전역 epoch */
+    int active;                     /* 읽기 구간 안이면 1 */
+    int in_use;                     /* 스레드가 이 기록을 쓰고 있으면 1 */
+    struct ep_rec *next;
+} __attribute__((aligned(64))) ep_rec_t;
+
+/* 회수 대기 노드 */
+typedef struct limbo {
+    void (*free_fn)(void *);
+    void *p;
+    unsigned long epoch;            /* 빼낸 때의 전역 epoch */
+    struct limbo *next;
+} limbo_t;
+
+static unsigned long global_epoch;
+static ep_rec_t *recs;              /* 기록 목록 (앞에 붙이기만 함) */
+static __thread ep_rec_t *self;
+
+static limbo_t *limbo_head, **limbo_tail = &limbo_head;  /* 오래된 것부터 */
+static unsigned long nlimbo, nfreed;
+static pthread_mutex_t limbo_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_key_t rec_key;
+static pthread_once_t rec_once = PTHREAD_ONCE_INIT;
+
+/* 스레드가 끝나면 기록을 다른 스레드가 쓸 수 있게 돌려놓음 */
+static void rec_put(void *p) {
+    __atomic_store_n(&((ep_rec_t *)p)->in_use, 0, __ATOMIC_RELEASE);
+}
+
+static void rec_key_init(void) {
+    pthread_key_create(&rec_key, rec_put);
+}
+
+/*
+ * rec_get - 쉬고 있는 기록을 재사용하거나 새로 만들어 이 스레드에 붙임
+ */
+static ep_rec_t *rec_get(void) {
+    ep_rec_t *r;
+    int zero;
+
+    pthread_once(&rec_once, rec_key_init);
+    for (r = __atomic_load_n(&recs, __ATOMIC_ACQUIRE); r; r = r->next) {
+        zero = 0;
+        if (__atomic_compare_exchange_n(&r->in_use, &zero, 1, 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+            break;
+    }
+    if (!r) {
+        if (posix_memalign((void **)&r, 64, sizeof(ep_rec_t)) != 0)
+            app_error("posix_memalign error");
+        memset(r, 0, sizeof(ep_rec_t));
+        r->in_use = 1;
+        r->next = __atomic_load_n(&recs, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&recs, &r->next, r, 0,
+                                            __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+            ;
+    }
+    pthread_setspecific(rec_key, r);
+    return r;
+}
+
+void epoch_enter(void) {
+    if (!self)
+        self = rec_get();
+    __atomic_store_n(&self->epoch, __atomic_load_n(&global_epoch, __ATOMIC_ACQUIRE),
+                     __ATOMIC_RELAXED);
+    __atomic_store_n(&self->active, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);    /* 이후의 읽기보다 먼저 보이게 */
+}
+
+void epoch_exit(void) {
+    __atomic_store_n(&self->active, 0, __ATOMIC_RELEASE);
+}
+
+/*
+ * try_advance - 활성 스레드가 모두 지금 epoch 에 있으면 epoch 을 올림
+ * (limbo_lock 을 잡고 호출)
+ */
+static void try_advance(void) {
+    unsigned long e = __atomic_load_n(&global_epoch, __ATOMIC_ACQUIRE);
+    ep_rec_t *r;
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    for (r = __atomic_load_n(&recs, __ATOMIC_ACQUIRE); r; r = r->next)
+        if (__atomic_load_n(&r->active, __ATOMIC_ACQUIRE) &&
+            __atomic_load_n(&r->epoch, __ATOMIC_ACQUIRE) != e)
+            return;
+    __atomic_store_n(&global_epoch, e + 1, __ATOMIC_RELEASE);
+}
+
+void epoch_retire(void (*free_fn)(void *), void *p) {
+    limbo_t *l = Malloc(sizeof(limbo_t)), *done = NULL;
+    unsigned long e;
+
+    pthread_mutex_lock(&limbo_lock);
+    l->free_fn = free_fn;
+    l->p = p;
+    l->epoch = __atomic_load_n(&global_epoch, __ATOMIC_ACQUIRE);
+    l->next = NULL;
+    *limbo_tail = l;
+    limbo_tail = &l->next;
+    nlimbo++;
+
+    /* 두 epoch 이 지난 것들을 떼어 내서 잠금 밖에서 해제 */
+    try_advance();
+    e = __atomic_load_n(&global_epoch, __ATOMIC_ACQUIRE);
+    if (limbo_head && limbo_head->epoch + 2 <= e) {
+        limbo_t **pp = &limbo_head;
+        done = limbo_head;
+        while (*pp && (*pp)->epoch + 2 <= e) {
+            pp = &(*pp)->next;
+            nlimbo--;
+            nfreed++;
+        }
+        limbo_head = *pp;
+        *pp = NULL;
+        if (!limbo_head)
+            limbo_tail = &limbo_head;
+    }
+    pthread_mutex_unlock(&limbo_lock);
+
+    while (done) {
+        l = done;
+        done = l->next;
+        l->free_fn(l->p);
+        Free(l);
+    }
+}
+
+/*
+ * epoch_stats - 전역 epoch 과 회수 대기 노드 수 출력
+ */
+void epoch_stats(FILE *fp) {
+    pthread_mutex_lock(&limbo_lock);
+    fprintf(fp, "epoch: %lu limbo %lu freed %lu\n",
+            __atomic_load_n(&global_epoch, __ATOMIC_RELAXED), nlimbo, nfreed);
+    pthread_mutex_unlock(&limbo_lock);
+}
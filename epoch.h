@@ -0,0 +1,20 @@
+/*
+ * epoch.h - epoch 기반 메모리 회수
+ */
+#ifndef __EPOCH_H__
+#define __EPOCH_H__
+
+#include <stdio.h>
+
+/* 읽기 구간: 이 안에서 읽은 공유 객체는 구간이 끝날 때까지 해제되지 않음.
+ * 구간 안에서 블로킹하거나 (코루틴이) 양보하면 안 됨 */
+void epoch_enter(void);
+void epoch_exit(void);
+
+/* 더 이상 새 읽기 구간에서 보이지 않게 된 p 를, 그 전부터 있던 읽기 구간이
+ * 모두 끝난 뒤 free_fn(p) 로 해제하도록 맡김 */
+void epoch_retire(void (*free_fn)(void *), void *p);
+
+void epoch_stats(FILE *fp);
+
+#endif /* __EPOCH_H__ */
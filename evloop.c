@@ -0,0 +1,463 @@
+/*
+ * evloop.c - epoll 기반 이벤트 구동 프록시 엔진 (-m epoll)
+ *
+ * 연결마다 스레드를 두는 대신, 코어당 하나의 이벤트 루프 스레드가
+ * 논블로킹 소켓과 연결별 상태 기계로 많은 클라이언트/서버 쌍을 동시에
+ * 다룬다. 응답하지 않는 서버(nop-server.py 같은 경우)가 있어도 연결
+ * 구조체 하나만 붙잡혀 있을 뿐 스레드와 스택 버퍼를 점유하지 않는다.
+ *
+ * 연결 상태 전이:
+ *   ST_READ_REQ  클라이언트 요청 헤더를 빈 줄까지 모음
+ *   ST_CONNECT   서버로 논블로킹 connect 진행 중
+ *   ST_SEND_REQ  변환한 요청을 서버로 전송
+ *   ST_RELAY     서버 응답을 클라이언트로 중계
+ *   (종료)       양쪽 소켓을 닫고 연결 구조체 해제
+ *
+ * 주의: 호스트 이름 해석(getaddrinfo)은 여전히 블로킹 호출이다.
+ */
+#define _GNU_SOURCE       /* accept4 */
+#include "proxy.h"
+#include "evloop.h"
+#include "admit.h"
+#include "limit.h"
+#include <sys/epoll.h>
+
+#define EV_MAX_EVENTS  256            /* epoll_wait 한 번에 받는 최대 이벤트 수 */
+#define EV_REQ_INIT    1024           /* 요청 버퍼 초기 크기 */
+#define EV_REQ_MAX     (4 * MAXBUF)   /* 요청 헤더 최대 크기 (넘으면 연결 종료) */
+#define EV_RELAY_SIZE  MAXBUF         /* 응답 중계 버퍼 크기 */
+
+enum conn_state { ST_READ_REQ, ST_CONNECT, ST_SEND_REQ, ST_RELAY, ST_CLOSED };
+
+struct conn;
+
+/* epoll 이벤트의 data.ptr 이 가리키는 대상 (리스닝 소켓이면 c == NULL) */
+typedef struct {
+    struct conn *c;
+    int is_server;
+} endpoint_t;
+
+typedef struct conn {
+    int state;
+    int clientfd, serverfd;
+    uint32_t cev, sev;              /* 현재 epoll 에 등록된 관심 이벤트 */
+    endpoint_t cep, sep;
+    char *buf;                      /* 요청 수신 버퍼 → 서버로 보낼 요청 */
+    size_t len, cap, off;
+    struct addrinfo *ai_list, *ai;  /* 연결을 시도할 서버 주소 목록 */
+    size_t rlen, roff;              /* 중계 버퍼에 남은 바이트 범위 */
+    int limited;                    /* 동시성 한도(-A) 자리를 차지하고 있음 */
+    long start;                     /* 서버 작업 시작 시각 (첫 응답 바이트 전까지 0이 아님) */
+    struct conn *next_dead;         /* 해제 대기 목록 링크 */
+    char relay[EV_RELAY_SIZE];
+} conn_t;
+
+typedef struct {
+    int epfd;
+    int listenfd;
+    conn_t *dead;                   /* 이번 epoll_wait 배치가 끝나면 해제할 연결 */
+} evloop_t;
+
+/* 루프 스레드 시작 인수 */
+typedef struct {
+    int listenfd;
+    int cpu;                        /* 고정할 CPU (-1이면 고정하지 않음) */
+} evloop_arg_t;
+
+static endpoint_t listen_ep = { NULL, 0 };
+
+static void start_connect(evloop_t *lp, conn_t *c);
+
+/*
+ * ev_ctl - epoll_ctl 래퍼
+ */
+static void ev_ctl(evloop_t *lp, int op, int fd, endpoint_t *ep, uint32_t events) {
+    struct epoll_event ev;
+
+    ev.events = events;
+    ev.data.ptr = ep;
+    if (epoll_ctl(lp->epfd, op, fd, &ev) < 0)
+        unix_error("epoll_ctl error");
+}
+
+/*
+ * want_client / want_server - 관심 이벤트가 바뀐 경우에만 epoll_ctl 호출
+ */
+static void want_client(evloop_t *lp, conn_t *c, uint32_t events) {
+    if (c->cev != events) {
+        ev_ctl(lp, EPOLL_CTL_MOD, c->clientfd, &c->cep, events);
+        c->cev = events;
+    }
+}
+
+static void want_server(evloop_t *lp, conn_t *c, uint32_t events) {
+    if (c->sev != events) {
+        ev_ctl(lp, EPOLL_CTL_MOD, c->serverfd, &c->sep, events);
+        c->sev = events;
+    }
+}
+
+/*
+ * conn_close - 연결 종료: 소켓을 닫으면 epoll 등록도 자동으로 해제된다
+ *
+ * 같은 배치 안에 이 연결의 다른 소켓 이벤트가 남아 있을 수 있으므로
+ * 구조체 자체는 배치 처리가 끝난 뒤에 해제한다.
+ */
+static void conn_close(evloop_t *lp, conn_t *c) {
+    close(c->clientfd);
+    if (c->serverfd >= 0)
+        close(c->serverfd);
+    if (c->ai_list)
+        freeaddrinfo(c->ai_list);
+    free(c->buf);
+    c->buf = NULL;
+    c->ai_list = NULL;
+    c->state = ST_CLOSED;
+    if (c->limited)
+        limit_release();
+    admit_end();
+    c->next_dead = lp->dead;
+    lp->dead = c;
+}
+
+/*
+ * on_accept - 대기 중인 연결을 모두 받아 ST_READ_REQ 상태로 등록
+ */
+static void on_accept(evloop_t *lp) {
+    struct sockaddr_storage clientaddr;
+    socklen_t clientlen;
+    int fd;
+
+    while (1) {
+        clientlen = sizeof(clientaddr);
+        fd = accept4(lp->listenfd, (SA *)&clientaddr, &clientlen, SOCK_NONBLOCK);
+        if (fd < 0) {
+            /* EAGAIN: 다른 루프가 먼저 가져갔거나 더 이상 없음 */
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                fprintf(stderr, "accept error: %s\n", strerror(errno));
+            return;
+        }
+        if (!admit_accept(fd))      /* 한도 초과: 503 을 보내고 이미 닫힘 */
+            continue;
+        admit_begin();
+
+        conn_t *c = Calloc(1, sizeof(conn_t));
+        c->state = ST_READ_REQ;
+        c->clientfd = fd;
+        c->serverfd = -1;
+        c->cep.c = c;
+        c->sep.c = c;
+        c->sep.is_server = 1;
+        c->cap = EV_REQ_INIT;
+        c->buf = Malloc(c->cap);
+        c->cev = EPOLLIN;
+        ev_ctl(lp, EPOLL_CTL_ADD, fd, &c->cep, c->cev);
+    }
+}
+
+/*
+ * start_request - 요청 헤더를 다 모았으면 파싱하고 서버 연결을 시작
+ */
+static void start_request(evloop_t *lp, conn_t *c) {
+    char method[MAXLINE], uri[MAXLINE], version[MAXLINE];
+    char hostname[MAXLINE], path[MAXLINE], portstr[8];
+    struct addrinfo hints;
+    char *hdrs, *out;
+    int port, rc;
+
+    /* 요청 라인 분리 (doit 과 동일한 규칙) */
+    hdrs = strstr(c->buf, "\r\n") + 2;
+    if (parse_request_line(c->buf, method, uri, version) < 0 ||
+        strcasecmp(method, "GET")) {
+        conn_close(lp, c);
+        return;
+    }
+    parse_uri(uri, hostname, path, &port);
+    sprintf(portstr, "%d", port);
+
+    /* 동시 서버 작업 수 한도 (-A): 루프를 막을 수 없으므로 차 있으면 바로 503 */
+    if (!limit_acquire(0)) {
+        admit_send_busy(c->clientfd);
+        conn_close(lp, c);
+        return;
+    }
+    c->limited = 1;
+    c->start = limit_now();
+
+    /* 서버로 보낼 요청을 한 번에 만들어 둠 */
+    out = Malloc(strlen(path) + strlen(hdrs) + REQUEST_TAIL_MAX + 32);
+    c->len = build_request(out, path, hdrs);
+    c->off = 0;
+    free(c->buf);
+    c->buf = out;
+
+    /* 클라이언트에게서는 더 읽을 것이 없음 (오류/끊김만 감시) */
+    want_client(lp, c, 0);
+
+    memset(&hints, 0, sizeof(struct addrinfo));
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_NUMERICSERV | AI_ADDRCONFIG;
+    if ((rc = getaddrinfo(hostname, portstr, &hints, &c->ai_list)) != 0) {
+        fprintf(stderr, "getaddrinfo failed (%s:%s): %s\n", hostname, portstr, gai_strerror(rc));
+        c->ai_list = NULL;
+        conn_close(lp, c);
+        return;
+    }
+    c->ai = c->ai_list;
+    start_connect(lp, c);
+}
+
+/*
+ * start_connect - c->ai 부터 차례로 논블로킹 connect 시도
+ */
+static void start_connect(evloop_t *lp, conn_t *c) {
+    for (; c->ai; c->ai = c->ai->ai_next) {
+        struct addrinfo *p = c->ai;
+        int fd = socket(p->ai_family, p->ai_socktype | SOCK_NONBLOCK, p->ai_protocol);
+        if (fd < 0)
+            continue;
+        if (connect(fd, p->ai_addr, p->ai_addrlen) == 0 || errno == EINPROGRESS) {
+            c->serverfd = fd;
+            c->state = ST_CONNECT;
+            c->sev = EPOLLOUT;
+            ev_ctl(lp, EPOLL_CTL_ADD, fd, &c->sep, c->sev);
+            return;
+        }
+        close(fd);
+    }
+    printf("Failed to connect to end server\n");
+    conn_close(lp, c);
+}
+
+/*
+ * flush_relay - 중계 버퍼를 클라이언트로 최대한 보내고 관심 이벤트를 조정
+ *
+ * 클라이언트가 느려 다 못 보냈으면 서버 읽기를 멈추고 클라이언트 쓰기 가능을
+ * 기다린다. 버퍼가 비면 다시 서버 읽기를 재개한다.
+ * 반환값: 연결을 닫았으면 -1
+ */
+static int flush_relay(evloop_t *lp, conn_t *c) {
+    while (c->roff < c->rlen) {
+        ssize_t n = write(c->clientfd, c->relay + c->roff, c->rlen - c->roff);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                want_server(lp, c, 0);
+                want_client(lp, c, EPOLLOUT);
+                return 0;
+            }
+            conn_close(lp, c);
+            return -1;
+        }
+        c->roff += n;
+    }
+    c->roff = c->rlen = 0;
+    want_client(lp, c, 0);
+    want_server(lp, c, EPOLLIN);
+    return 0;
+}
+
+/*
+ * on_client - 클라이언트 소켓 이벤트 처리
+ */
+static void on_client(evloop_t *lp, conn_t *c, uint32_t events) {
+    if (c->state == ST_CLOSED)
+        return;
+    if (events & (EPOLLERR | EPOLLHUP)) {
+        conn_close(lp, c);
+        return;
+    }
+
+    if (c->state == ST_RELAY) {     /* 밀린 응답을 이어서 전송 */
+        flush_relay(lp, c);
+        return;
+    }
+    if (c->state != ST_READ_REQ)
+        return;
+
+    /* 요청 헤더를 빈 줄("\r\n\r\n")이 나올 때까지 모음 */
+    while (1) {
+        if (c->len + 1 == c->cap) {
+            if (c->cap >= EV_REQ_MAX) {
+                conn_close(lp, c);      /* 헤더가 너무 큼 */
+                return;
+            }
+            c->cap *= 2;
+            c->buf = Realloc(c->buf, c->cap);
+        }
+        ssize_t n = read(c->clientfd, c->buf + c->len, c->cap - c->len - 1);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return;
+            conn_close(lp, c);
+            return;
+        }
+        if (n == 0) {               /* 요청을 다 보내기 전에 끊김 */
+            conn_close(lp, c);
+            return;
+        }
+        c->len += n;
+        c->buf[c->len] = '\0';
+        if (strstr(c->buf, "\r\n\r\n")) {
+            printf("Request line: %.*s", (int)(strstr(c->buf, "\r\n") - c->buf + 2), c->buf);
+            start_request(lp, c);
+            return;
+        }
+    }
+}
+
+/*
+ * on_server - 서버 소켓 이벤트 처리
+ */
+static void on_server(evloop_t *lp, conn_t *c, uint32_t events) {
+    int err;
+    socklen_t errlen = sizeof(err);
+    ssize_t n;
+
+    switch (c->state) {
+    case ST_CLOSED:
+    case ST_READ_REQ:
+        return;
+
+    case ST_CONNECT:
+        /* 연결 결과 확인: 실패하면 다음 주소로 재시도 */
+        if (getsockopt(c->serverfd, SOL_SOCKET, SO_ERROR, &err, &errlen) < 0 || err != 0) {
+            close(c->serverfd);
+            c->serverfd = -1;
+            c->ai = c->ai->ai_next;
+            start_connect(lp, c);
+            return;
+        }
+        c->state = ST_SEND_REQ;
+        /* fall through */
+
+    case ST_SEND_REQ:
+        while (c->off < c->len) {
+            n = write(c->serverfd, c->buf + c->off, c->len - c->off);
+            if (n < 0) {
+                if (errno == EINTR)
+                    continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                    return;
+                conn_close(lp, c);
+                return;
+            }
+            c->off += n;
+        }
+        free(c->buf);
+        c->buf = NULL;
+        c->state = ST_RELAY;
+        want_server(lp, c, EPOLLIN);
+        return;
+
+    case ST_RELAY:
+        if (c->roff < c->rlen)      /* 아직 클라이언트로 못 보낸 데이터가 있음 */
+            return;
+        n = read(c->serverfd, c->relay, EV_RELAY_SIZE);
+        if (n < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)
+                return;
+            conn_close(lp, c);
+            return;
+        }
+        if (n == 0) {               /* 서버가 응답을 끝까지 보냄 */
+            conn_close(lp, c);
+            return;
+        }
+        if (c->start) {             /* 첫 응답 바이트: 서버 지연 샘플 */
+            limit_sample(limit_now() - c->start);
+            c->start = 0;
+        }
+        c->rlen = n;
+        c->roff = 0;
+        flush_relay(lp, c);
+        return;
+    }
+    (void)events;
+}
+
+/*
+ * evloop_thread - 이벤트 루프 하나를 실행하는 스레드 함수
+ *
+ * 각 루프는 자신만의 epoll 인스턴스를 가지며, 리스닝 소켓은
+ * EPOLLEXCLUSIVE 로 등록해 새 연결마다 루프 하나만 깨어나도록 한다.
+ * (SO_REUSEPORT 샤딩에서는 루프마다 리스닝 소켓이 따로 있다)
+ */
+static void *evloop_thread(void *vargp) {
+    evloop_t loop;
+    struct epoll_event events[EV_MAX_EVENTS];
+    int i, n;
+
+    loop.listenfd = ((evloop_arg_t *)vargp)->listenfd;
+    pin_thread(((evloop_arg_t *)vargp)->cpu);
+    Free(vargp);
+    loop.dead = NULL;
+    if ((loop.epfd = epoll_create1(0)) < 0)
+        unix_error("epoll_create1 error");
+    ev_ctl(&loop, EPOLL_CTL_ADD, loop.listenfd, &listen_ep, EPOLLIN | EPOLLEXCLUSIVE);
+
+    while (1) {
+        n = epoll_wait(loop.epfd, events, EV_MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            unix_error("epoll_wait error");
+        }
+        for (i = 0; i < n; i++) {
+            endpoint_t *ep = events[i].data.ptr;
+            if (ep->c == NULL)
+                on_accept(&loop);
+            else if (ep->is_server)
+                on_server(&loop, ep->c, events[i].events);
+            else
+                on_client(&loop, ep->c, events[i].events);
+        }
+        while (loop.dead) {
+            conn_t *c = loop.dead;
+            loop.dead = c->next_dead;
+            free(c);
+        }
+    }
+    return NULL;
+}
+
+/*
+ * evloop_arg - 루프 스레드에 넘길 인수를 만들고 리스닝 소켓을 논블로킹으로 설정
+ */
+static evloop_arg_t *evloop_arg(int listenfd, int cpu) {
+    evloop_arg_t *arg = Malloc(sizeof(evloop_arg_t));
+
+    if (fcntl(listenfd, F_SETFL, fcntl(listenfd, F_GETFL, 0) | O_NONBLOCK) < 0)
+        unix_error("fcntl error");
+    arg->listenfd = listenfd;
+    arg->cpu = cpu;
+    return arg;
+}
+
+/*
+ * evloop_start - listenfd 를 처리하는 이벤트 루프 스레드 하나를 띄움
+ *
+ * cpu >= 0 이면 루프 스레드를 해당 CPU 에 고정한다.
+ */
+void evloop_start(int listenfd, int cpu) {
+    pthread_t tid;
+
+    topo_thread_create(&tid, evloop_thread, evloop_arg(listenfd, cpu), cpu);
+    Pthread_detach(tid);
+}
+
+/*
+ * evloop_run - nloops 개의 이벤트 루프를 띄우고 첫 루프는 호출한 스레드에서 실행
+ *
+ * -c 로 CPU 목록을 줬으면 루프들을 그 CPU 에 차례로 고정한다.
+ */
+void evloop_run(int listenfd, int nloops) {
+    int i;
+
+    for (i = 1; i < nloops; i++)
+        evloop_start(listenfd, topo_cpu(i));
+    evloop_thread(evloop_arg(listenfd, topo_cpu(0)));
+}
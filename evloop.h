@@ -0,0 +1,13 @@
+/*
+ * evloop.h - epoll 기반 이벤트 구동 엔진 (-m epoll)
+ */
+#ifndef __EVLOOP_H__
+#define __EVLOOP_H__
+
+/* nloops 개의 이벤트 루프 스레드로 listenfd 의 연결을 처리 (반환하지 않음) */
+void evloop_run(int listenfd, int nloops);
+
+/* listenfd 를 처리하는 루프 스레드 하나를 띄움 (cpu >= 0 이면 해당 CPU 에 고정) */
+void evloop_start(int listenfd, int cpu);
+
+#endif /* __EVLOOP_H__ */
@@ -0,0 +1,341 @@
+/*
+ * flight.c - 같은 URI 의 동시 미스를 서버 요청 하나로 모음 (collapsed forwarding)
+ *
+ * 인기 있는 객체가 처음 요청되거나 캐시에서 빠진 순간 여러 클라이언트가
+ * 한꺼번에 미스를 내면, 모두가 각자 서버에 연결해 같은 응답을 받는다.
+ * 여기서는 캐시 키(정규화한 URI)마다 진행 중인 fetch 를 하나만 둔다:
+ *
+ * - 처음 미스를 낸 요청이 리더가 되어 서버에서 가져오고, 클라이언트에
+ *   보내는 조각을 flight 버퍼에도 붙인다 (이 버퍼가 곧 캐시에 넣을 사본).
+ * - 같은 키로 뒤따라온 요청은 서버에 가지 않고 flight 에 붙어 버퍼를
+ *   처음부터 읽는다. 리더가 아직 받는 중이면 새 조각이 올 때마다 깨어나
+ *   이어서 보낸다. 그래서 캐시 객체 최대 크기를 넘는 응답도 함께 받는다.
+ * - 따라 읽는 쪽은 리더가 응답 헤더를 다 읽고 나눠 줄 수 있다고 정할 때까지
+ *   (flight_share) 아무것도 받지 않는다. 200, 206 이 아니거나 캐시할 수 없는
+ *   응답 (private, no-store 등) 이면 flight 를 목록에서 빼고 따라 읽던 쪽들을
+ *   깨워 각자 서버에서 가져오게 한다.
+ * - 리더는 응답이 끝나면 (캐시할 수 있으면) 먼저 캐시에 넣고 나서 flight 를
+ *   목록에서 뺀다. 그 뒤에 온 요청은 캐시에서 적중한다.
+ * - 버퍼가 캐시 객체 최대 크기를 넘으면 목록에서 뺀다 (그 뒤에 온 요청은 처음부터
+ *   읽을 수 없으므로 새 리더가 됨). 그 뒤로는 모든 쪽이 읽은 앞부분을 버리며,
+ *   FLIGHT_WINDOW 보다 뒤처진 쪽은 떼어 낸다. 그래서 큰 응답을 따라 읽는 쪽이
+ *   있어도 버퍼는 캐시 객체 최대 크기와 FLIGHT_WINDOW 중 큰 쪽을 넘지 않는다.
+ *
+ * 기다림은 따라 읽는 쪽마다 만드는 eventfd 로 한다. 리더는 기다리는 쪽의
+ * eventfd 에만 쓰고, 기다리는 쪽은 코루틴 안이면 io_wait_hook 으로 양보하고
+ * 아니면 poll 로 잔다. 그래서 코루틴 스케줄러 스레드를 막지 않는다.
+ *
+ * flight 하나의 상태는 그 flight 의 잠금으로, 목록은 table_lock 으로
+ * 지킨다 (잡는 순서: table_lock → flight 잠금).
+ */
+#include "csapp.h"
+#include "cache.h"
+#include "flight.h"
+#include <poll.h>
+#include <sys/eventfd.h>
+
+#define FLIGHT_BUCKETS 256
+#define FLIGHT_WINDOW (1 << 20)     /* 캐시할 수 없는 큰 응답에서 따라 읽는 쪽이 뒤처져도 되는 바이트 */
+
+struct flight {
+    char *key;
+    unsigned hash;
+    pthread_mutex_t lock;
+    char *data;                     /* 리더가 보낸 응답의 [base, len) (버렸으면 NULL) */
+    size_t base, len, cap;
+    int ready;                      /* 리더가 응답 헤더를 보고 나눠 줄지 정함 */
+    int unshared;                   /* 나눠 줄 수 없는 응답 (따라 읽는 쪽은 직접 가져옴) */
+    int done;                       /* 리더가 끝냄 */
+    int dropped;                    /* 버퍼를 버림 (따라 읽을 수 없음) */
+    int linked;                     /* 목록에 있음 */
+    int refcnt;                     /* 리더 + 따라 읽는 쪽 수 */
+    freader_t *readers;
+    struct flight *next;            /* 해시 체인 */
+};
+
+static flight_t *table[FLIGHT_BUCKETS];
+static pthread_mutex_t table_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* 통계 (table_lock 이나 flight 잠금 안에서 갱신) */
+static unsigned long nleaders, nfollowers, ndropped, ncancels, nunshared, nlagged;
+static int nflights;
+
+/* FNV-1a */
+static unsigned hash_key(const char *key) {
+    unsigned h = 2166136261u;
+
+    while (*key)
+        h = (h ^ (unsigned char)*key++) * 16777619u;
+    return h;
+}
+
+static void flight_put(flight_t *f) {
+    if (__atomic_sub_fetch(&f->refcnt, 1, __ATOMIC_ACQ_REL) > 0)
+        return;
+    pthread_mutex_destroy(&f->lock);
+    Free(f->key);
+    Free(f->data);
+    Free(f);
+}
+
+/* unlink_flight - 목록에서 뺌 (table_lock 을 잡고 호출) */
+static void unlink_flight(flight_t *f) {
+    flight_t **pp = &table[f->hash % FLIGHT_BUCKETS];
+
+    if (!f->linked)
+        return;
+    while (*pp != f)
+        pp = &(*pp)->next;
+    *pp = f->next;
+    f->linked = 0;
+    nflights--;
+}
+
+/* wake - 기다리는 쪽들을 깨움 (flight 잠금을 잡고 호출) */
+static void wake(flight_t *f) {
+    uint64_t one = 1;
+    freader_t *r;
+
+    for (r = f->readers; r; r = r->next) {
+        if (!r->waiting)
+            continue;
+        r->waiting = 0;
+        if (write(r->efd, &one, sizeof(one)) < 0)
+            fprintf(stderr, "eventfd write error: %s\n", strerror(errno));
+    }
+}
+
+flight_t *flight_join(const char *uri, freader_t *r) {
+    char key[strlen(uri) + 2];
+    unsigned h;
+    flight_t *f;
+
+    cache_key(uri, key);
+    h = hash_key(key);
+
+    pthread_mutex_lock(&table_lock);
+    for (f = table[h % FLIGHT_BUCKETS]; f; f = f->next)
+        if (f->hash == h && !strcmp(f->key, key))
+            break;
+    if (f) {
+        /* 따라 읽는 쪽으로 붙음 */
+        pthread_mutex_lock(&f->lock);
+        r->f = f;
+        r->off = 0;
+        r->efd = -1;
+        r->waiting = 0;
+        r->lagged = 0;
+        r->next = f->readers;
+        f->readers = r;
+        __atomic_add_fetch(&f->refcnt, 1, __ATOMIC_RELAXED);
+        nfollowers++;
+        pthread_mutex_unlock(&f->lock);
+        pthread_mutex_unlock(&table_lock);
+        return NULL;
+    }
+
+    /* 새 리더 */
+    f = Calloc(1, sizeof(flight_t));
+    f->key = Malloc(strlen(key) + 1);
+    strcpy(f->key, key);
+    f->hash = h;
+    pthread_mutex_init(&f->lock, NULL);
+    f->refcnt = 1;
+    f->linked = 1;
+    f->next = table[h % FLIGHT_BUCKETS];
+    table[h % FLIGHT_BUCKETS] = f;
+    nleaders++;
+    nflights++;
+    pthread_mutex_unlock(&table_lock);
+    return f;
+}
+
+/*
+ * stop_joins - 캐시할 수 없게 커진 응답: 목록에서 빼서 더 붙지 못하게 하고,
+ * 따라 읽는 쪽이 없으면 버퍼도 버림
+ */
+static void stop_joins(flight_t *f) {
+    pthread_mutex_lock(&table_lock);
+    pthread_mutex_lock(&f->lock);
+    unlink_flight(f);
+    if (!f->readers) {
+        f->dropped = 1;
+        Free(f->data);
+        f->data = NULL;
+        f->base = f->len = f->cap = 0;
+        ndropped++;
+    }
+    pthread_mutex_unlock(&f->lock);
+    pthread_mutex_unlock(&table_lock);
+}
+
+/*
+ * slide - 모두가 읽은 앞부분을 버림. 새로 n 바이트를 붙이면 FLIGHT_WINDOW 보다
+ * 뒤처지는 쪽은 떼어 냄 (flight 잠금을 잡고 호출, 캐시할 수 없게 커진 뒤에만)
+ */
+static void slide(flight_t *f, size_t n) {
+    size_t lo = f->len;
+    freader_t *r;
+
+    for (r = f->readers; r; r = r->next) {
+        if (r->lagged)
+            continue;
+        if (f->len + n - r->off > FLIGHT_WINDOW) {
+            r->lagged = 1;
+            nlagged++;
+        } else if (r->off < lo) {
+            lo = r->off;
+        }
+    }
+    if (lo > f->base) {
+        memmove(f->data, f->data + (lo - f->base), f->len - lo);
+        f->base = lo;
+    }
+}
+
+void flight_append(flight_t *f, const char *buf, size_t n) {
+    if (f->dropped)
+        return;
+    if (f->len + n > cache_max_object() && f->linked) {
+        stop_joins(f);
+        if (f->dropped)
+            return;
+    }
+
+    pthread_mutex_lock(&f->lock);
+    if (f->len - f->base + n > f->cap && f->len + n > cache_max_object())
+        slide(f, n);
+    if (f->len - f->base + n > f->cap) {
+        f->cap = f->cap ? 2 * f->cap : MAXBUF;
+        while (f->cap < f->len - f->base + n)
+            f->cap *= 2;
+        f->data = Realloc(f->data, f->cap);
+    }
+    memcpy(f->data + (f->len - f->base), buf, n);
+    f->len += n;
+    wake(f);
+    pthread_mutex_unlock(&f->lock);
+}
+
+void flight_share(flight_t *f, int shareable) {
+    pthread_mutex_lock(&table_lock);
+    if (!shareable)
+        unlink_flight(f);
+    pthread_mutex_lock(&f->lock);
+    f->ready = 1;
+    if (!shareable) {
+        f->unshared = 1;
+        nunshared++;
+    }
+    wake(f);
+    pthread_mutex_unlock(&f->lock);
+    pthread_mutex_unlock(&table_lock);
+}
+
+/* flight_data - 리더만 버퍼를 바꾸므로 리더는 잠금 없이 읽어도 됨 */
+const char *flight_data(flight_t *f, size_t *len) {
+    if (f->dropped || f->len > cache_max_object())
+        return NULL;
+    *len = f->len;
+    return f->data;
+}
+
+void flight_finish(flight_t *f) {
+    pthread_mutex_lock(&table_lock);
+    unlink_flight(f);
+    pthread_mutex_unlock(&table_lock);
+
+    pthread_mutex_lock(&f->lock);
+    f->done = 1;
+    wake(f);
+    pthread_mutex_unlock(&f->lock);
+    flight_put(f);
+}
+
+/* flight_cancel - 서버에 가지 않고 끝냄 (그사이 캐시에 들어온 것을 찾음) */
+void flight_cancel(flight_t *f) {
+    pthread_mutex_lock(&table_lock);
+    nleaders--;
+    ncancels++;
+    pthread_mutex_unlock(&table_lock);
+    flight_finish(f);
+}
+
+/*
+ * wait_fd - fd 를 읽을 수 있을 때까지 기다림 (코루틴이면 스케줄러로 양보)
+ */
+static void wait_fd(int fd) {
+    struct pollfd pfd;
+    uint64_t v;
+
+    if (!io_wait_hook || io_wait_hook(fd, IO_WAIT_READ) < 0) {
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        while (poll(&pfd, 1, -1) < 0 && errno == EINTR)
+            ;
+    }
+    if (read(fd, &v, sizeof(v)) < 0 && errno != EAGAIN)
+        fprintf(stderr, "eventfd read error: %s\n", strerror(errno));
+}
+
+ssize_t flight_read(freader_t *r, char *buf, size_t size) {
+    flight_t *f = r->f;
+    size_t n;
+
+    pthread_mutex_lock(&f->lock);
+    while ((!f->ready || r->off >= f->len) && !f->done && !f->unshared && !r->lagged) {
+        if (r->efd < 0 && (r->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+            pthread_mutex_unlock(&f->lock);
+            fprintf(stderr, "eventfd error: %s\n", strerror(errno));
+            return -1;
+        }
+        r->waiting = 1;
+        pthread_mutex_unlock(&f->lock);
+        wait_fd(r->efd);
+        pthread_mutex_lock(&f->lock);
+    }
+    if (r->lagged) {
+        pthread_mutex_unlock(&f->lock);
+        return -1;
+    }
+    if (f->unshared) {
+        pthread_mutex_unlock(&f->lock);
+        return 0;
+    }
+    n = f->len - r->off < size ? f->len - r->off : size;
+    if (n > 0) {
+        memcpy(buf, f->data + (r->off - f->base), n);
+        r->off += n;
+    }
+    pthread_mutex_unlock(&f->lock);
+    return n;
+}
+
+int flight_unshared(const freader_t *r) {
+    return __atomic_load_n(&r->f->unshared, __ATOMIC_ACQUIRE);
+}
+
+void flight_leave(freader_t *r) {
+    flight_t *f = r->f;
+    freader_t **pp;
+
+    pthread_mutex_lock(&f->lock);
+    for (pp = &f->readers; *pp != r; pp = &(*pp)->next)
+        ;
+    *pp = r->next;
+    pthread_mutex_unlock(&f->lock);
+    if (r->efd >= 0)
+        close(r->efd);
+    flight_put(f);
+}
+
+/*
+ * flight_stats - 리더 수(서버로 간 미스), 따라간 요청 수(서버에 가지 않은 미스) 출력
+ */
+void flight_stats(FILE *fp) {
+    pthread_mutex_lock(&table_lock);
+    fprintf(fp, "flight: %d in flight leaders %lu followers %lu dropped %lu late hits %lu "
+            "unshared %lu lagged %lu\n",
+            nflights, nleaders, nfollowers, ndropped, ncancels, nunshared, nlagged);
+    pthread_mutex_unlock(&table_lock);
+}
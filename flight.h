@@ -0,0 +1,53 @@
+/*
+ * flight.h - 같은 URI 의 동시 미스를 서버 요청 하나로 모음 (collapsed forwarding)
+ */
+#ifndef __FLIGHT_H__
+#define __FLIGHT_H__
+
+#include <stdio.h>
+#include <sys/types.h>
+
+typedef struct flight flight_t;
+
+/* 리더가 가져오는 응답을 따라 읽는 쪽 하나 (따라가는 요청의 스택에 둠) */
+typedef struct freader {
+    flight_t *f;
+    size_t off;                 /* 다음에 읽을 위치 */
+    int efd;                    /* 리더가 새 데이터를 알리는 eventfd (처음 기다릴 때 만듦) */
+    int waiting;                /* 알림을 기다리는 중 */
+    int lagged;                 /* 너무 뒤처져 떼어 냄 (더 읽을 수 없음) */
+    struct freader *next;
+} freader_t;
+
+/* uri 를 가져오는 중인 리더가 없으면 새 리더가 되어 그 flight 를 돌려줌.
+ * 이미 있으면 r 을 따라 읽는 쪽으로 붙이고 NULL */
+flight_t *flight_join(const char *uri, freader_t *r);
+
+/* 리더: 클라이언트에 보낸 응답 조각을 따라 읽는 쪽들에게도 보냄 */
+void flight_append(flight_t *f, const char *buf, size_t n);
+
+/* 리더: 응답 헤더를 읽고 나서, 따라 읽는 쪽들에게 나눠 줄 수 있는 응답인지 알림.
+ * 알리기 전에 붙인 조각은 끝날 때까지 보이지 않음. 나눠 줄 수 없으면 목록에서
+ * 빼고 따라 읽는 쪽들을 깨움 (flight_read 가 0, flight_unshared 가 1) */
+void flight_share(flight_t *f, int shareable);
+
+/* 리더: 모은 응답 (캐시 객체 최대 크기를 넘었거나 버렸으면 NULL) */
+const char *flight_data(flight_t *f, size_t *len);
+
+/* 리더: 응답이 끝났음을 알리고 목록에서 뺌 (리더의 참조도 놓음) */
+void flight_finish(flight_t *f);
+
+/* 리더: 서버에 가지 않고 끝냄 (리더가 된 뒤 캐시에서 찾았을 때) */
+void flight_cancel(flight_t *f);
+
+/* 따라 읽는 쪽: 다음 조각을 buf 에 복사 (올 때까지 기다림). 끝이면 0,
+ * 너무 뒤처져 떼어 냈으면 -1 */
+ssize_t flight_read(freader_t *r, char *buf, size_t size);
+
+/* 따라 읽는 쪽: 리더가 나눠 줄 수 없는 응답이라고 알렸는지 (직접 가져와야 함) */
+int flight_unshared(const freader_t *r);
+void flight_leave(freader_t *r);
+
+void flight_stats(FILE *fp);
+
+#endif /* __FLIGHT_H__ */
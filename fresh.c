@@ -0,0 +1,225 @@
+/*
+ * fresh.c - 서버 응답 헤더로 캐시 신선도와 검증자를 계산
+ *
+ * 중계하는 응답 헤더를 한 줄씩 fresh_header 에 넘기면 캐시에 필요한
+ * 정보만 모은다:
+ *
+ * - 저장 여부: Cache-Control 의 no-store, private 이면 캐시하지 않는다.
+ *   Authorization 을 보낸 요청의 응답은 public, s-maxage, must-revalidate
+ *   중 하나가 있을 때만 캐시한다 (다른 사용자에게 보내도 된다는 뜻).
+ *   Cookie 를 보낸 요청의 응답은 사용자별일 수 있으므로 public 이나
+ *   s-maxage 가 있을 때만 캐시한다.
+ * - 신선 기간: s-maxage > max-age > Expires - Date 순으로 쓰고, 모두
+ *   없으면 Last-Modified 로부터 지난 시간의 10% (최대 하루) 를 쓴다.
+ *   그것도 없으면 -T 로 정한 기본값을 쓴다. 서버가 준 Age 만큼은 뺀다.
+ *   no-cache 면 0 (쓸 때마다 재검증).
+ * - 재검증 유예: stale-while-revalidate=N 이면 만료된 뒤 N 초 동안은 만료
+ *   사본을 바로 보내고 백그라운드에서 재검증한다 (refresh.c). 없으면 -V 로
+ *   정한 기본값 (기본 0). no-cache, must-revalidate 면 유예하지 않는다.
+ * - 오류 시 만료 사본: stale-if-error=N 이면 만료된 뒤 N 초 동안은 서버가
+ *   실패해도 만료 사본을 대신 보낸다. 없으면 -X 로 정한 기본값 (기본 0).
+ *   no-cache, must-revalidate 면 보내지 않는다.
+ *
+ * 클라이언트가 보낸 조건부 요청을 캐시 객체의 검증자와 비교하는 일
+ * (fresh_match) 도 여기서 한다. If-None-Match 가 있으면 그것만 보고 (약한
+ * 비교), 없으면 If-Modified-Since 를 Last-Modified 와 비교한다.
+ * - 검증자: ETag, Last-Modified 값을 그대로 보관해 두었다가 재검증할 때
+ *   If-None-Match, If-Modified-Since 로 보낸다.
+ * - 변형: Vary 의 이름 목록을 정규화해 모은다 (vary.c). 캐시는 요청의 그
+ *   헤더 값들로 같은 URI 의 변형을 고른다. Vary: * 는 캐시하지 않는다.
+ */
+#define _GNU_SOURCE
+#include "csapp.h"
+#include "fresh.h"
+
+#define FRESH_DEFAULT_TTL   60          /* -T 를 주지 않았을 때의 기본 신선 기간 (초) */
+#define FRESH_HEURISTIC_MAX (24 * 3600) /* Last-Modified 로 추정하는 기간의 상한 */
+
+static long default_ttl = FRESH_DEFAULT_TTL;
+static long default_swr = 0;
+static long default_sie = 0;
+
+void fresh_set_default(long secs) {
+    default_ttl = secs;
+}
+
+void fresh_set_swr_default(long secs) {
+    default_swr = secs;
+}
+
+void fresh_set_sie_default(long secs) {
+    default_sie = secs;
+}
+
+void fresh_init(fresh_t *f) {
+    f->max_age = f->s_maxage = -1;
+    f->age = 0;
+    f->swr = f->sie = -1;
+    f->date = f->expires = f->last_modified = -1;
+    f->no_store = f->no_cache = f->is_private = f->is_public = f->auth_ok = 0;
+    f->must_revalidate = 0;
+    f->etag[0] = '\0';
+    f->last_modified_str[0] = '\0';
+    f->vary[0] = '\0';
+}
+
+time_t fresh_parse_date(const char *s) {
+    struct tm tm;
+
+    memset(&tm, 0, sizeof(tm));
+    if (!strptime(s, "%a, %d %b %Y %H:%M:%S GMT", &tm))
+        return -1;
+    return timegm(&tm);
+}
+
+/* copy_value - 앞뒤 공백과 줄바꿈을 뗀 헤더 값을 out 에 복사 */
+static void copy_value(char *out, size_t size, const char *v) {
+    size_t n;
+
+    while (*v == ' ' || *v == '\t')
+        v++;
+    n = strcspn(v, "\r\n");
+    if (n >= size)
+        n = size - 1;
+    memcpy(out, v, n);
+    out[n] = '\0';
+}
+
+/* cache_control - Cache-Control 값의 지시어들을 반영 */
+static void cache_control(fresh_t *f, const char *v) {
+    char buf[MAXLINE], *tok, *save;
+
+    copy_value(buf, sizeof(buf), v);
+    for (tok = strtok_r(buf, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        while (*tok == ' ')
+            tok++;
+        if (!strncasecmp(tok, "max-age=", 8))
+            f->max_age = atol(tok + 8);
+        else if (!strncasecmp(tok, "s-maxage=", 9))
+            f->s_maxage = atol(tok + 9);
+        else if (!strncasecmp(tok, "no-store", 8))
+            f->no_store = 1;
+        else if (!strncasecmp(tok, "no-cache", 8))
+            f->no_cache = 1;
+        else if (!strncasecmp(tok, "private", 7))
+            f->is_private = 1;
+        else if (!strncasecmp(tok, "public", 6))
+            f->is_public = f->auth_ok = 1;
+        else if (!strncasecmp(tok, "stale-while-revalidate=", 23))
+            f->swr = atol(tok + 23);
+        else if (!strncasecmp(tok, "stale-if-error=", 15))
+            f->sie = atol(tok + 15);
+        else if (!strncasecmp(tok, "must-revalidate", 15))
+            f->must_revalidate = f->auth_ok = 1;
+        else if (!strncasecmp(tok, "proxy-revalidate", 16))
+            f->must_revalidate = 1;
+    }
+}
+
+void fresh_header(fresh_t *f, const char *line) {
+    char val[FRESH_VALIDATOR];
+
+    if (!strncasecmp(line, "Cache-Control:", 14)) {
+        cache_control(f, line + 14);
+    } else if (!strncasecmp(line, "Expires:", 8)) {
+        copy_value(val, sizeof(val), line + 8);
+        if ((f->expires = fresh_parse_date(val)) < 0)
+            f->expires = 0;             /* 잘못된 값은 이미 지난 것으로 (RFC 9111) */
+    } else if (!strncasecmp(line, "Date:", 5)) {
+        copy_value(val, sizeof(val), line + 5);
+        f->date = fresh_parse_date(val);
+    } else if (!strncasecmp(line, "Age:", 4)) {
+        f->age = atol(line + 4);
+    } else if (!strncasecmp(line, "Last-Modified:", 14)) {
+        copy_value(f->last_modified_str, sizeof(f->last_modified_str), line + 14);
+        f->last_modified = fresh_parse_date(f->last_modified_str);
+    } else if (!strncasecmp(line, "ETag:", 5)) {
+        copy_value(f->etag, sizeof(f->etag), line + 5);
+    } else if (!strncasecmp(line, "Vary:", 5)) {
+        vary_fields(f->vary, sizeof(f->vary), line + 5);
+    }
+}
+
+int fresh_storable(const fresh_t *f, int auth, int cookie) {
+    if (auth && !f->auth_ok && f->s_maxage < 0)
+        return 0;
+    if (cookie && !f->is_public && f->s_maxage < 0)
+        return 0;
+    return !f->no_store && !f->is_private && strcmp(f->vary, "*");
+}
+
+long fresh_lifetime(const fresh_t *f) {
+    time_t date = f->date >= 0 ? f->date : time(NULL);
+    long life;
+
+    if (f->no_cache)
+        return 0;
+    if (f->s_maxage >= 0)
+        life = f->s_maxage;
+    else if (f->max_age >= 0)
+        life = f->max_age;
+    else if (f->expires >= 0)
+        life = f->expires - date;
+    else if (f->last_modified >= 0 && date > f->last_modified) {
+        life = (date - f->last_modified) / 10;
+        if (life > FRESH_HEURISTIC_MAX)
+            life = FRESH_HEURISTIC_MAX;
+    } else
+        life = default_ttl;
+    life -= f->age;
+    return life > 0 ? life : 0;
+}
+
+long fresh_swr(const fresh_t *f) {
+    if (f->no_cache || f->must_revalidate)
+        return 0;
+    return f->swr >= 0 ? f->swr : default_swr;
+}
+
+long fresh_sie(const fresh_t *f) {
+    if (f->no_cache || f->must_revalidate)
+        return 0;
+    return f->sie >= 0 ? f->sie : default_sie;
+}
+
+/* etag_equal - 약한 비교: W/ 를 떼고 따옴표 안의 값이 같은지 (b 는 n 바이트) */
+static int etag_equal(const char *a, const char *b, size_t n) {
+    size_t alen;
+
+    if (!strncmp(a, "W/", 2))
+        a += 2;
+    if (n >= 2 && !strncmp(b, "W/", 2)) {
+        b += 2;
+        n -= 2;
+    }
+    alen = strlen(a);
+    return alen == n && !strncmp(a, b, n);
+}
+
+int fresh_match(const char *if_none_match, const char *if_modified_since,
+                const char *etag, const char *last_modified) {
+    const char *p = if_none_match;
+    time_t ims, lm;
+    size_t n;
+
+    if (*if_none_match) {
+        if (!etag)
+            return 0;
+        /* 쉼표로 구분한 목록, "*" 는 무엇이든 맞음 */
+        while (*p) {
+            while (*p == ' ' || *p == '\t' || *p == ',')
+                p++;
+            n = strcspn(p, ", \t");
+            if ((n == 1 && *p == '*') || (n > 0 && etag_equal(etag, p, n)))
+                return 1;
+            p += n;
+        }
+        return 0;
+    }
+    if (*if_modified_since && last_modified) {
+        ims = fresh_parse_date(if_modified_since);
+        lm = fresh_parse_date(last_modified);
+        return ims >= 0 && lm >= 0 && lm <= ims;
+    }
+    return 0;
+}
@@ -0,0 +1,66 @@
+/*
+ * fresh.h - 서버 응답 헤더로 캐시 신선도와 검증자를 계산
+ */
+#ifndef __FRESH_H__
+#define __FRESH_H__
+
+#include <time.h>
+#include "vary.h"
+
+#define FRESH_VALIDATOR 256         /* ETag / Last-Modified 값의 최대 길이 */
+
+/* 응답 헤더 하나하나에서 모은 캐시 관련 정보 */
+typedef struct {
+    long max_age;               /* Cache-Control max-age (-1 이면 없음) */
+    long s_maxage;              /* Cache-Control s-maxage (-1 이면 없음) */
+    long age;                   /* Age 헤더 (초) */
+    long swr;                   /* Cache-Control stale-while-revalidate (-1 이면 없음) */
+    long sie;                   /* Cache-Control stale-if-error (-1 이면 없음) */
+    time_t date, expires, last_modified;    /* HTTP 날짜 (-1 이면 없음) */
+    int no_store, no_cache, is_private;
+    int is_public;              /* public */
+    int auth_ok;                /* public, must-revalidate: Authorization 요청의 응답도 저장 가능 */
+    int must_revalidate;        /* must-revalidate, proxy-revalidate: 만료 사본을 쓰면 안 됨 */
+    char etag[FRESH_VALIDATOR];
+    char last_modified_str[FRESH_VALIDATOR];
+    char vary[VARY_MAX];        /* 정규화한 Vary 이름 목록 ("" 이면 없음, "*" 면 고를 수 없음) */
+} fresh_t;
+
+/* 헤더가 없을 때의 기본 신선 기간 (-T, 초) */
+void fresh_set_default(long secs);
+
+/* 서버가 stale-while-revalidate 를 주지 않았을 때의 재검증 유예 기간 (-V, 초) */
+void fresh_set_swr_default(long secs);
+
+/* 서버가 stale-if-error 를 주지 않았을 때, 서버 오류에 만료 사본을 대신 보내는 기간 (-X, 초) */
+void fresh_set_sie_default(long secs);
+
+void fresh_init(fresh_t *f);
+
+/* 응답 헤더 한 줄 ("Name: value\r\n") 을 반영 (관련 없는 헤더는 무시) */
+void fresh_header(fresh_t *f, const char *line);
+
+/* 공유 캐시에 넣어도 되는 응답인지 (no-store, private, Vary: * 가 아님).
+ * auth 면 Authorization 을 보낸 요청의 응답이므로 public, s-maxage,
+ * must-revalidate 중 하나가 있어야 함 (RFC 9111 3.5). cookie 면 Cookie 를
+ * 보낸 요청의 응답이므로 사용자별 응답일 수 있어 public, s-maxage 가 있어야 함 */
+int fresh_storable(const fresh_t *f, int auth, int cookie);
+
+/* 지금부터 신선한 기간 (초, 0이면 쓰기 전에 항상 재검증) */
+long fresh_lifetime(const fresh_t *f);
+
+/* 만료된 뒤 백그라운드에서 재검증하는 동안 만료 사본을 보내도 되는 기간 (초) */
+long fresh_swr(const fresh_t *f);
+
+/* 만료된 뒤 서버가 실패하면 (연결 실패, 시간 초과, 5xx) 만료 사본을 대신 보내도 되는 기간 (초) */
+long fresh_sie(const fresh_t *f);
+
+/* 클라이언트의 조건부 요청 (If-None-Match, If-Modified-Since 값, 없으면 "") 이
+ * 캐시 객체의 검증자 (없으면 NULL) 와 맞아서 304 를 보내도 되는지 */
+int fresh_match(const char *if_none_match, const char *if_modified_since,
+                const char *etag, const char *last_modified);
+
+/* HTTP 날짜 문자열을 time_t 로 (형식이 틀리면 -1) */
+time_t fresh_parse_date(const char *s);
+
+#endif /* __FRESH_H__ */
@@ -0,0 +1,141 @@
+/*
+ * lane.c - 캐시 적중과 미스를 나눠 처리하는 차선 (-W)
+ *
+ * pool 모드의 워커들이 미스를 직접 처리하면, 느린 서버를 기다리는 미스가
+ * 워커를 모두 붙잡아 바로 보낼 수 있는 적중 요청까지 큐에서 기다리게
+ * 된다. -W 를 주면 doit 은 요청 라인을 파싱한 직후 캐시를 보고:
+ *
+ * - 적중이면 그 자리에서 바로 보낸다 (기존 워커 = 적중 차선)
+ * - 미스면 요청을 미스 큐에 넘기고 다음 연결로 돌아간다
+ *
+ * 미스 큐는 따로 만든 미스 워커들(-W 개)만 처리하므로, 서버가 느려져도
+ * 적중 차선의 워커는 붙잡히지 않는다. 미스 큐가 가득 차면 적중 차선이
+ * 기다리지 않도록 503 으로 거절한다.
+ *
+ * 적중/미스 지연은 따로 모아 -S 로 출력한다 (요청 라인을 읽은 때부터
+ * 응답을 다 보낼 때까지, 미스는 미스 큐에서 기다린 시간 포함).
+ */
+#include "lane.h"
+
+#define LANE_BUCKETS 32             /* 지연 히스토그램: 2^i 마이크로초 단위 */
+
+/* 미스 큐: 요청 포인터의 원형 배열 */
+static request_t **queue;
+static int depth, front, count;
+static pthread_mutex_t qlock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t qitems = PTHREAD_COND_INITIALIZER;
+static int nmiss_workers;
+
+/* 적중(1)/미스(0) 별 지연 통계 */
+typedef struct {
+    unsigned long n;
+    unsigned long sum, max;
+    unsigned long bucket[LANE_BUCKETS];
+} lat_t;
+static lat_t lat[2];
+static pthread_mutex_t lat_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * miss_worker - 미스 큐에서 요청을 꺼내 서버로 보내는 일을 반복
+ */
+static void *miss_worker(void *vargp) {
+    request_t *req;
+
+    Pthread_detach(pthread_self());
+    pin_thread((int)(long)vargp);
+    while (1) {
+        pthread_mutex_lock(&qlock);
+        while (count == 0)
+            pthread_cond_wait(&qitems, &qlock);
+        req = queue[front];
+        front = (front + 1) % depth;
+        count--;
+        pthread_mutex_unlock(&qlock);
+
+        serve_miss(req);
+        Close(req->clientfd);
+        request_free(req);
+    }
+    return NULL;
+}
+
+void lane_init(int nmiss, int qdepth) {
+    pthread_t tid;
+    int i;
+
+    if (nmiss <= 0)
+        return;
+    nmiss_workers = nmiss;
+    depth = qdepth;
+    queue = Calloc(depth, sizeof(request_t *));
+    for (i = 0; i < nmiss; i++)
+        topo_thread_create(&tid, miss_worker, (void *)(long)topo_cpu(i), topo_cpu(i));
+}
+
+int lane_enabled(void) {
+    return nmiss_workers > 0;
+}
+
+int lane_submit(request_t *req) {
+    pthread_mutex_lock(&qlock);
+    if (count == depth) {
+        pthread_mutex_unlock(&qlock);
+        return 0;
+    }
+    queue[(front + count) % depth] = req;
+    count++;
+    pthread_cond_signal(&qitems);
+    pthread_mutex_unlock(&qlock);
+    return 1;
+}
+
+void lane_record(int hit, long usec) {
+    lat_t *l = &lat[hit ? 1 : 0];
+    int b = 0;
+
+    if (usec < 0)
+        usec = 0;
+    while (b < LANE_BUCKETS - 1 && (1L << b) <= usec)
+        b++;
+    pthread_mutex_lock(&lat_lock);
+    l->n++;
+    l->sum += usec;
+    if ((unsigned long)usec > l->max)
+        l->max = usec;
+    l->bucket[b]++;
+    pthread_mutex_unlock(&lat_lock);
+}
+
+/*
+ * percentile - 히스토그램에서 p (0~1) 분위가 들어 있는 구간의 상한
+ */
+static unsigned long percentile(lat_t *l, double p) {
+    unsigned long seen = 0;
+    int b;
+
+    for (b = 0; b < LANE_BUCKETS; b++) {
+        seen += l->bucket[b];
+        if (seen >= p * l->n)
+            return 1UL << b;
+    }
+    return l->max;
+}
+
+/*
+ * lane_stats - 적중/미스 지연과 미스 큐 깊이 출력
+ */
+void lane_stats(FILE *fp) {
+    int i;
+
+    pthread_mutex_lock(&lat_lock);
+    for (i = 1; i >= 0; i--) {
+        lat_t *l = &lat[i];
+        fprintf(fp, "lane %s: n %lu avg %luus p50 <%luus p99 <%luus max %luus\n",
+                i ? "hit " : "miss", l->n, l->n ? l->sum / l->n : 0,
+                l->n ? percentile(l, 0.5) : 0, l->n ? percentile(l, 0.99) : 0, l->max);
+    }
+    pthread_mutex_unlock(&lat_lock);
+    if (lane_enabled())
+        fprintf(fp, "lane miss queue: %d/%d (%d workers)\n",
+                __atomic_load_n(&count, __ATOMIC_RELAXED), depth, nmiss_workers);
+}
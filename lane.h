@@ -0,0 +1,21 @@
+/*
+ * lane.h - 캐시 적중과 미스를 나눠 처리하는 차선 (-W)
+ */
+#ifndef __LANE_H__
+#define __LANE_H__
+
+#include "proxy.h"
+
+/* nmiss > 0 이면 미스 전용 워커 nmiss 개와 깊이 depth 의 미스 큐를 만듦 */
+void lane_init(int nmiss, int depth);
+int lane_enabled(void);
+
+/* 미스 요청을 미스 큐에 넣음 (소유권이 넘어감). 큐가 가득 차면 0 */
+int lane_submit(request_t *req);
+
+/* 요청 하나의 지연을 적중/미스 별로 기록 (마이크로초) */
+void lane_record(int hit, long usec);
+
+void lane_stats(FILE *fp);
+
+#endif /* __LANE_H__ */
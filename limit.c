@@ -0,0 +1,158 @@
+/*
+ * limit.c - 서버 지연에 따라 스스로 조절되는 동시성 한도 (-A)
+ *
+ * 원 서버의 처리 능력은 시간에 따라 바뀌므로 고정된 한도(-L)는 너무
+ * 빡빡하거나 너무 느슨하다. 여기서는 서버 쪽 작업(연결 + 중계)을 동시에
+ * 몇 개까지 할지를 관측한 지연으로 계속 조절한다 (gradient 방식):
+ *
+ *   gradient  = 장기 평균 지연 / 이번 지연          (0.5 ~ 1.0 로 자름)
+ *   new_limit = limit * gradient + sqrt(limit)
+ *   limit     = limit * (1 - LIMIT_SMOOTHING) + new_limit * LIMIT_SMOOTHING
+ *
+ * 지연이 평소 수준이면 gradient 가 1이라 sqrt(limit) 만큼 늘어나고, 서버가
+ * 밀려 지연이 늘면 비율만큼 줄어든다. 처리 중인 작업이 한도의 절반도
+ * 안 되면 한도가 실제로 검증되지 않으므로 바꾸지 않는다.
+ *
+ * 지연은 서버 연결 시작부터 응답 첫 바이트까지 잰다. 응답 전체를 중계하는
+ * 시간은 객체 크기에 따라 달라져서 서버가 밀린 것과 구분되지 않기 때문이다.
+ *
+ * 한도가 차면 스레드 모드는 LIMIT_QUEUE_MS 동안 자리가 나길 기다리고,
+ * 그래도 안 되거나 기다릴 수 없는 엔진(epoll, uring, coro)이면 503 으로
+ * 거절한다.
+ */
+#include "csapp.h"
+#include "limit.h"
+#include <math.h>
+
+#define LIMIT_INIT        20      /* 시작 한도 */
+#define LIMIT_MIN         1
+#define LIMIT_LONG_WINDOW 100     /* 장기 평균 지연의 지수 이동 평균 창 (샘플 수) */
+#define LIMIT_SMOOTHING   0.2     /* 새 한도를 반영하는 비율 */
+#define LIMIT_QUEUE_MS    100     /* 한도가 찼을 때 기다리는 최대 시간 */
+
+static int enabled;
+static int max_limit;
+static double limit;              /* 현재 한도 (정수 부분만 적용) */
+static double rtt_long;           /* 장기 평균 지연 (마이크로초) */
+static long rtt_last;             /* 마지막 샘플 */
+static int inflight;              /* 서버 쪽 작업 중인 요청 수 */
+static int nwaiting;              /* 자리를 기다리는 요청 수 */
+static unsigned long nsamples, nshed;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t room = PTHREAD_COND_INITIALIZER;
+
+void limit_init(int max) {
+    enabled = max > 0;
+    max_limit = max;
+    limit = LIMIT_INIT < max ? LIMIT_INIT : max;
+}
+
+long limit_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000L + ts.tv_nsec / 1000;
+}
+
+/*
+ * limit_acquire - 한도 안이면 자리를 하나 차지
+ *
+ * 기다리는 요청도 한도만큼만 두고, 그 이상은 바로 거절한다.
+ */
+int limit_acquire(int wait) {
+    struct timespec deadline;
+    int ok = 1;
+
+    if (!enabled)
+        return 1;
+
+    pthread_mutex_lock(&lock);
+    if (inflight >= (int)limit) {
+        if (!wait || nwaiting >= (int)limit) {
+            ok = 0;
+        } else {
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += LIMIT_QUEUE_MS * 1000000L;
+            deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+            deadline.tv_nsec %= 1000000000L;
+            nwaiting++;
+            while (inflight >= (int)limit && ok)
+                if (pthread_cond_timedwait(&room, &lock, &deadline) == ETIMEDOUT)
+                    ok = inflight < (int)limit;
+            nwaiting--;
+        }
+    }
+    if (ok)
+        inflight++;
+    else
+        nshed++;
+    pthread_mutex_unlock(&lock);
+    return ok;
+}
+
+void limit_release(void) {
+    if (!enabled)
+        return;
+    pthread_mutex_lock(&lock);
+    inflight--;
+    pthread_cond_signal(&room);
+    pthread_mutex_unlock(&lock);
+}
+
+/*
+ * limit_sample - 서버 지연 샘플 하나로 한도를 갱신
+ */
+void limit_sample(long usec) {
+    double gradient, new_limit;
+    int old;
+
+    if (!enabled)
+        return;
+    if (usec < 1)
+        usec = 1;
+
+    pthread_mutex_lock(&lock);
+    nsamples++;
+    rtt_last = usec;
+    if (rtt_long == 0)
+        rtt_long = usec;
+    else
+        rtt_long += (usec - rtt_long) / LIMIT_LONG_WINDOW;
+
+    /* 장기 평균이 지금보다 훨씬 크면 (밀렸다가 풀린 직후) 빨리 따라 내려감 */
+    if (rtt_long > 2.0 * usec)
+        rtt_long *= 0.95;
+
+    old = (int)limit;
+    if (inflight >= limit / 2) {
+        gradient = rtt_long / usec;
+        if (gradient < 0.5)
+            gradient = 0.5;
+        if (gradient > 1.0)
+            gradient = 1.0;
+        new_limit = limit * gradient + sqrt(limit);
+        limit = limit * (1 - LIMIT_SMOOTHING) + new_limit * LIMIT_SMOOTHING;
+        if (limit < LIMIT_MIN)
+            limit = LIMIT_MIN;
+        if (limit > max_limit)
+            limit = max_limit;
+    }
+    if ((int)limit > old)
+        pthread_cond_broadcast(&room);
+    pthread_mutex_unlock(&lock);
+}
+
+/*
+ * limit_stats - 현재 한도와 지연, 거절 횟수 출력
+ */
+void limit_stats(FILE *fp) {
+    if (!enabled)
+        return;
+    pthread_mutex_lock(&lock);
+    fprintf(fp, "limit: %d (max %d) inflight %d waiting %d rtt last %ldus avg %.0fus "
+                "samples %lu shed %lu\n",
+            (int)limit, max_limit, inflight, nwaiting, rtt_last, rtt_long,
+            nsamples, nshed);
+    pthread_mutex_unlock(&lock);
+}
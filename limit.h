@@ -0,0 +1,24 @@
+/*
+ * limit.h - 서버 지연에 따라 스스로 조절되는 동시성 한도 (-A)
+ */
+#ifndef __LIMIT_H__
+#define __LIMIT_H__
+
+#include <stdio.h>
+
+/* max_limit > 0 이면 한도 조절을 켬 (한도는 1 ~ max_limit 사이에서 움직임) */
+void limit_init(int max_limit);
+
+/* 서버 쪽 작업을 시작해도 되는지: 되면 1, 거절해야 하면 0.
+ * wait 가 0이 아니면 자리가 날 때까지 잠깐 기다린다 */
+int limit_acquire(int wait);
+void limit_release(void);
+
+/* 지연 측정: limit_now() 로 시작 시각을 재고, 서버 응답의 첫 바이트가
+ * 오면 limit_sample(limit_now() - 시작) 으로 알려 줌 (마이크로초) */
+long limit_now(void);
+void limit_sample(long usec);
+
+void limit_stats(FILE *fp);
+
+#endif /* __LIMIT_H__ */
@@ -0,0 +1,201 @@
+/*
+ * neg.c - 서버 오류(404, 410)와 호스트 이름 조회 실패를 잠깐 기억하는 부정 캐시
+ *
+ * 없는 URI 를 긁어 가는 크롤러나 깨진 페이지가 같은 요청을 반복하면 매번
+ * 서버 연결 (이름을 못 찾는 호스트면 DNS 조회) 비용을 다시 낸다. -N 으로
+ * 보관 기간을 주면 그런 실패를 그 기간 동안 여기에 기억해 두고, 같은 요청은
+ * 서버에 가지 않고 기억한 응답으로 바로 실패시킨다.
+ *
+ * - 404, 410 응답: 정규화한 URI (cache_key) 를 키로 서버 응답을 그대로
+ *   보관한다. NEG_MAX_OBJECT 보다 큰 응답은 상태 줄과 빈 본문만 남긴다.
+ * - 호스트 이름 조회 실패 (open_clientfd 가 -2): "dns 호스트" 를 키로 502 를
+ *   보관한다. 공백은 URI 에 없으므로 URI 키와 섞이지 않는다.
+ *
+ * 객체 캐시와는 따로 용량(budget)을 두어 실패 응답이 정상 객체를 밀어내지
+ * 않는다. 넘치면 가장 먼저 들어온 것부터 내보내고, 만료된 항목은 찾을 때
+ * 지운다. 미스 경로에서만 보고 양도 적으므로 잠금 하나로 보호한다.
+ */
+#include "csapp.h"
+#include "neg.h"
+#include "cache.h"
+
+#define NEG_BUCKETS    1024         /* 해시 테이블 크기 */
+#define NEG_MAX_OBJECT 4096         /* 그대로 보관하는 실패 응답의 최대 크기 */
+
+/* 기억한 실패 하나 */
+typedef struct nent {
+    char *key;
+    char *data;                 /* 클라이언트에 보낼 응답 전체 */
+    size_t size;
+    size_t charge;              /* 용량에서 차지하는 바이트 (구조체, 키 포함) */
+    time_t expires;
+    struct nent *hnext;         /* 해시 체인 */
+    struct nent *prev, *next;   /* 들어온 순서 (앞이 최근) */
+} nent_t;
+
+static nent_t *buckets[NEG_BUCKETS];
+static nent_t *head, *tail;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static long ttl;
+static size_t used, budget;
+static int nents;
+static unsigned long nhits, ninserts, nevicts;
+
+/* FNV-1a */
+static unsigned hash_key(const char *key) {
+    unsigned h = 2166136261u;
+
+    while (*key)
+        h = (h ^ (unsigned char)*key++) * 16777619u;
+    return h;
+}
+
+/* host_key - 호스트 이름 조회 실패의 키 ("dns " + 소문자 호스트) */
+static void host_key(const char *host, char *out) {
+    out += sprintf(out, "dns ");
+    while (*host)
+        *out++ = tolower((unsigned char)*host++);
+    *out = '\0';
+}
+
+void neg_init(long secs, size_t size) {
+    ttl = secs;
+    budget = size;
+}
+
+/* 아래 함수들은 잠금을 잡고 호출 */
+
+static nent_t **find_slot(const char *key) {
+    nent_t **pp = &buckets[hash_key(key) % NEG_BUCKETS];
+
+    while (*pp && strcmp((*pp)->key, key))
+        pp = &(*pp)->hnext;
+    return pp;
+}
+
+static void remove_ent(nent_t *e) {
+    nent_t **pp = find_slot(e->key);
+
+    *pp = e->hnext;
+    if (e->prev)
+        e->prev->next = e->next;
+    else
+        head = e->next;
+    if (e->next)
+        e->next->prev = e->prev;
+    else
+        tail = e->prev;
+    used -= e->charge;
+    nents--;
+    Free(e->key);
+    Free(e->data);
+    Free(e);
+}
+
+/* put - key 로 data 를 보관 (같은 키가 있으면 교체) */
+static void put(const char *key, const char *data, size_t len) {
+    size_t keylen = strlen(key) + 1;
+    size_t charge = sizeof(nent_t) + keylen + len;
+    nent_t *e, **pp;
+
+    if (ttl <= 0 || charge > budget)
+        return;
+    e = Malloc(sizeof(nent_t));
+    e->key = Malloc(keylen);
+    memcpy(e->key, key, keylen);
+    e->data = Malloc(len);
+    memcpy(e->data, data, len);
+    e->size = len;
+    e->charge = charge;
+    e->expires = time(NULL) + ttl;
+
+    pthread_mutex_lock(&lock);
+    if (*(pp = find_slot(key)))
+        remove_ent(*pp);
+    while (used + charge > budget) {
+        remove_ent(tail);
+        nevicts++;
+    }
+    pp = find_slot(key);
+    e->hnext = NULL;
+    *pp = e;
+    e->prev = NULL;
+    e->next = head;
+    if (head)
+        head->prev = e;
+    else
+        tail = e;
+    head = e;
+    used += charge;
+    nents++;
+    ninserts++;
+    pthread_mutex_unlock(&lock);
+}
+
+void neg_insert(const char *uri, int status, const char *data, size_t len) {
+    char key[strlen(uri) + 2], buf[MAXLINE];
+
+    if (ttl <= 0)
+        return;
+    cache_key(uri, key);
+    if (!data || len > NEG_MAX_OBJECT) {
+        len = sprintf(buf, "HTTP/1.0 %d %s\r\nContent-length: 0\r\n\r\n",
+                      status, status == 410 ? "Gone" : "Not Found");
+        data = buf;
+    }
+    put(key, data, len);
+}
+
+void neg_insert_host(const char *host) {
+    static const char msg[] = "HTTP/1.0 502 Bad Gateway\r\n"
+                              "Content-Type: text/plain\r\n"
+                              "Content-length: 25\r\n\r\n"
+                              "Could not resolve host.\r\n";
+    char key[strlen(host) + 8];
+
+    if (ttl <= 0)
+        return;
+    host_key(host, key);
+    put(key, msg, sizeof(msg) - 1);
+}
+
+/* get - key 의 보관된 응답을 buf 에 복사 (만료됐으면 지우고 0) */
+static size_t get(const char *key, char *buf, size_t size) {
+    nent_t *e;
+    size_t n = 0;
+
+    pthread_mutex_lock(&lock);
+    if ((e = *find_slot(key)) != NULL) {
+        if (e->expires <= time(NULL)) {
+            remove_ent(e);
+        } else if (e->size <= size) {
+            memcpy(buf, e->data, e->size);
+            n = e->size;
+            nhits++;
+        }
+    }
+    pthread_mutex_unlock(&lock);
+    return n;
+}
+
+size_t neg_lookup(const char *uri, const char *host, char *buf, size_t size) {
+    char ukey[strlen(uri) + 2], hkey[strlen(host) + 8];
+    size_t n;
+
+    if (ttl <= 0)
+        return 0;
+    cache_key(uri, ukey);
+    if ((n = get(ukey, buf, size)) > 0)
+        return n;
+    host_key(host, hkey);
+    return get(hkey, buf, size);
+}
+
+void neg_stats(FILE *fp) {
+    if (ttl <= 0)
+        return;
+    pthread_mutex_lock(&lock);
+    fprintf(fp, "neg: %d entries %zu/%zu bytes hits %lu inserts %lu evictions %lu ttl %lds\n",
+            nents, used, budget, nhits, ninserts, nevicts, ttl);
+    pthread_mutex_unlock(&lock);
+}
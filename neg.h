@@ -0,0 +1,26 @@
+/*
+ * neg.h - 서버 오류(404, 410)와 호스트 이름 조회 실패를 잠깐 기억하는 부정 캐시
+ */
+#ifndef __NEG_H__
+#define __NEG_H__
+
+#include <stdio.h>
+#include <stddef.h>
+
+/* 보관 기간 ttl 초 (0 이면 끔), 객체 캐시와 따로 쓰는 용량 budget 바이트 */
+void neg_init(long ttl, size_t budget);
+
+/* uri 의 실패 응답 (status 404, 410) 을 보관. data 가 NULL 이거나 너무 크면
+ * 상태 줄과 빈 본문만 보관 */
+void neg_insert(const char *uri, int status, const char *data, size_t len);
+
+/* host 의 이름을 찾지 못했음을 보관 (그 호스트로 가는 요청에는 502) */
+void neg_insert_host(const char *host);
+
+/* uri 나 그 호스트 host 에 보관된 실패 응답을 buf 에 복사.
+ * 반환값: 복사한 바이트 수 (없거나 만료됐으면 0) */
+size_t neg_lookup(const char *uri, const char *host, char *buf, size_t size);
+
+void neg_stats(FILE *fp);
+
+#endif /* __NEG_H__ */
@@ -10,53 +10,396 @@
  * 멀티스레딩을 통해 여러 클라이언트 요청을 동시에 처리
  */
 
+#define _GNU_SOURCE       // CPU 집합 (cpu_set_t, sched_getaffinity)
 #include <stdio.h>
 #include <pthread.h>      // 멀티스레딩을 위한 pthread 라이브러리
+#include <sched.h>        // CPU 집합 (cpu_set_t)
 
-/* 캐시 관련 상수 정의 (Part III에서 사용 예정) */
-#define MAX_CACHE_SIZE 1049000    // 최대 캐시 크기: 1MB
-#define MAX_OBJECT_SIZE 102400    // 캐시 가능한 객체 최대 크기: 100KB
+/* 캐시 관련 상수 정의 (cache.c, -C/-O 로 바꿀 수 있음) */
+#define MAX_CACHE_SIZE 1049000    // 최대 캐시 크기 기본값: 1MB
+#define MAX_OBJECT_SIZE 102400    // 캐시 가능한 객체 최대 크기 기본값: 100KB
 
 /* 프록시가 서버에게 보낼 User-Agent 헤더 (브라우저 식별 정보) */
 static const char *user_agent_hdr =
     "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:10.0.3) Gecko/20120305 "
     "Firefox/10.0.3\r\n";
 
-#include "csapp.h"        // 교재에서 제공하는 소켓 프로그래밍 라이브러리
+#include "proxy.h"        // 프록시 공용 선언 (csapp.h 포함)
+#include "sbuf.h"         // 프리스레드 모드의 연결 큐
+#include "evloop.h"       // epoll 이벤트 구동 엔진
+#include "coro.h"         // 코루틴 런타임
+#include "steal.h"        // 작업 훔치기 워커 풀
+#include "admit.h"        // 진입 제어 (503 부하 차단)
+#include "limit.h"        // 서버 지연에 따른 동시성 한도
+#include "cache.h"        // 웹 객체 캐시
+#include "flight.h"       // 같은 URI 의 동시 미스 모으기
+#include "fresh.h"        // 응답 신선도와 재검증
+#include "refresh.h"      // 재검증 유예 기간의 백그라운드 재검증
+#include "range.h"        // Range 요청 해석
+#include "slice.h"        // 큰 응답을 조각으로 나눠 캐시
+#include "vary.h"         // Vary 변형 키
+#include "neg.h"          // 404, 410, DNS 실패를 잠깐 기억
+#include "lane.h"         // 적중/미스 분리 차선
+#ifdef HAVE_IO_URING
+#include "uring.h"        // io_uring 엔진 (make proxy-uring)
+#endif
+
+/* 프리스레드 모드 기본값 */
+#define DEFAULT_SBUF_SIZE 16      // 연결 큐 깊이 기본값
+
+/* 백그라운드 재검증 (refresh.c) */
+#define REFRESH_WORKERS 2         // 재검증 워커 수
+#define REFRESH_QUEUE 64          // 재검증 큐 깊이
+
+/* 만료 사본을 대신 보낼 수 있을 때 서버 응답을 기다리는 최대 시간 (초) */
+#define ORIGIN_TIMEOUT 5
+
+/* 404, 410, 호스트 이름 조회 실패를 기억하는 부정 캐시의 용량 (캐시 용량과 별도, neg.c) */
+#define NEG_CACHE_SIZE (256 * 1024)
+
+/* 만료 사본에 붙이는 Warning 헤더 값 (RFC 7234) */
+#define WARN_STALE "110 - \"Response is Stale\""
+#define WARN_REVALIDATE_FAILED "111 - \"Revalidation Failed\""
+
+/* 연결 처리 방식 (-m 옵션) */
+enum proxy_mode {
+    MODE_THREAD,    // 연결마다 스레드 생성 (기본값)
+    MODE_POOL,      // 프리스레드 워커 + 연결 큐
+    MODE_EPOLL,     // 코어당 epoll 이벤트 루프
+    MODE_URING,     // 코어당 io_uring 링 (proxy-uring 빌드에서만)
+    MODE_CORO,      // 연결마다 코루틴, 코어당 스케줄러 스레드
+    MODE_STEAL      // 워커별 덱 + 작업 훔치기
+};
+
+/* 연결 처리 설정 (명령행 옵션) */
+static int mode = -1;                       // 연결 처리 방식 (-1: 옵션으로 결정)
+static int nthreads = 0;                    // 워커/이벤트 루프 수
+static int sbufsize = DEFAULT_SBUF_SIZE;    // 연결 큐 깊이
+static int stats_interval = 0;              // 통계 출력 주기 (초, 0이면 출력 안 함)
+
+/*
+ * 샤드: 리스닝 소켓 하나와 그 소켓의 연결을 처리하는 accept 스레드/워커 묶음
+ * 
+ * 기본은 샤드 하나(모든 스레드 공유). -r 을 주면 CPU 마다 SO_REUSEPORT
+ * 리스닝 소켓을 따로 열어, 커널이 새 연결을 샤드들에 나눠 주고 각 샤드의
+ * 스레드는 자기 CPU 에 고정된다.
+ */
+typedef struct {
+    int listenfd;
+    int cpu;            // 이 샤드의 스레드를 고정할 CPU (-1이면 고정하지 않음)
+    int nworkers;       // pool 모드 워커 수
+    sbuf_t sbuf;        // pool 모드에서 이 샤드 전용 연결 큐
+} shard_t;
+
+/* pool 모드 워커 인수: 속한 샤드와 고정할 CPU */
+typedef struct {
+    shard_t *sh;
+    int cpu;
+} worker_arg_t;
 
 /* 함수 프로토타입 선언 */
-void parse_uri(char *uri, char *hostname, char *path, int *port);
 void doit(int clientfd);
 void *thread_routine(void *vargp);
+void *worker_routine(void *vargp);
+static void *shard_routine(void *vargp);
+static void serve(shard_t *sh);
+static void start_shards(char *port);
+static void *stats_routine(void *vargp);
+static void usage(char *prog);
+static void serve_hit(request_t *req, cobj_t *obj);
+static int serve_follower(request_t *req, freader_t *follow);
+static int serve_stale(request_t *req, flight_t *f);
+static void read_req_hdrs(request_t *req);
+static void send_stale(request_t *req, flight_t *f, cobj_t *obj, const char *warning);
+static void send_not_modified(request_t *req, cobj_t *obj);
+static void send_client(request_t *req, const char *buf, size_t n);
+static void send_cached(request_t *req, cobj_t *obj);
+static void serve_sliced(request_t *req, cobj_t *head);
+static int forward_hdrs(int serverfd, request_t *req, int strip);
+static int fresh_meta(fresh_t *fr, request_t *req, char *vkey, cmeta_t *meta);
+static void read_cond_hdr(request_t *req, const char *line);
+static int is_conditional_hdr(const char *line);
+static long parse_size(const char *s);
 
 /*
  * main - 프록시 서버의 메인 함수
  * 
+ * 사용법: proxy [-m thread|pool|epoll|uring|coro|steal] [-n 스레드수] [-q 큐깊이] [-r] [-S 초] [-c CPU목록]
+ *              [-L 처리중한도] [-P 대기한도] [-M 메모리MB] [-A 최대한도] [-W 미스워커수]
+ *              [-C 캐시크기] [-O 객체최대크기] [-K 샤드수] [-E lru|tinylfu|gdsf]
+ *              [-T 기본신선초] [-V 재검증유예초] [-X 오류시만료허용초] [-Z 조각크기]
+ *              [-N 실패기억초] <port>
+ * 
  * 역할:
  * 1. 지정된 포트에서 클라이언트 연결 대기
- * 2. 연결이 들어올 때마다 새로운 스레드 생성
- * 3. 각 스레드가 독립적으로 클라이언트 요청 처리
+ * 2. thread 모드(기본): 연결이 들어올 때마다 새로운 스레드 생성
+ * 3. pool 모드: 미리 만들어 둔 N개의 워커에게 연결 큐로 전달
+ *    (-m 없이 -n 만 주면 pool 모드)
+ * 4. epoll 모드: N개(기본값: 코어 수)의 이벤트 루프가 논블로킹으로 처리
+ * 5. uring 모드: N개의 io_uring 링이 accept/connect/중계를 묶어서 제출
+ * 6. coro 모드: 연결마다 코루틴으로 doit 을 실행, N개의 스케줄러 스레드가 구동
+ * 7. steal 모드: N개의 워커가 각자 덱에 연결을 받고, 놀면 다른 워커 것을 훔침
+ * 8. -r: CPU 마다 SO_REUSEPORT 리스닝 소켓과 고정된 스레드 묶음(샤드)을 둠
+ * 9. -S: 초 단위 주기로 내부 통계를 stderr 에 출력
+ * 10. -c: 워커를 "0-3,8" 같은 CPU 목록에 하나씩 고정하고 버퍼를 그 노드에 할당
+ * 11. -L/-P/-M: 처리 중 연결 수, 대기 연결 수, 메모리(MB) 한도.
+ *     넘으면 accept 직후 503 + Retry-After 로 바로 거절 (admit.c)
+ * 12. -A: 서버 지연을 보고 동시 서버 작업 수 한도를 최대값 안에서 자동 조절 (limit.c)
+ * 13. -W: 캐시 미스를 전용 워커 N개와 미스 큐(-q 깊이)로 넘겨, 적중 요청이
+ *     느린 미스 뒤에서 기다리지 않게 함 (lane.c)
+ * 14. -C/-O: 캐시 용량과 객체 최대 크기 (바이트, K/M/G 접미사 가능)
+ * 15. -K: 캐시 샤드 수 (2의 거듭제곱, 샤드마다 잠금과 LRU 가 따로 있음)
+ * 16. -E: 캐시 정책. lru(기본)는 모두 받아들이고, tinylfu 는 내보낼 객체보다
+ *     최근에 더 자주 요청된 객체만 받아들임 (sketch.c). gdsf 는 빈도 / 크기가
+ *     작은 객체부터 내보내 작은 객체를 많이 남김 (객체 적중률 우선)
+ * 17. -T: 서버가 신선도 헤더(Cache-Control, Expires, Last-Modified)를 주지
+ *     않은 응답의 신선 기간 (초). 지나면 서버에 재검증 (fresh.c)
+ * 18. -V: 서버가 stale-while-revalidate 를 주지 않은 응답의 재검증 유예 기간
+ *     (초, 기본 0). 만료된 뒤 이 기간 안에는 만료 사본을 바로 보내고
+ *     백그라운드에서 한 번만 재검증 (refresh.c)
+ * 19. -X: 서버가 stale-if-error 를 주지 않은 응답을, 만료된 뒤 서버가 실패하면
+ *     (연결 실패, 시간 초과, 5xx) 대신 보내도 되는 기간 (초, 기본 0).
+ *     Warning, Age 헤더를 붙여 만료 사본을 보냄
+ * 20. -Z: -O 보다 큰 응답을 이 크기 (바이트, K/M/G 접미사 가능, 최대 -O) 의
+ *     조각으로 나눠 캐시. Range 요청은 필요한 조각만으로 답하고 캐시에 없는
+ *     조각만 서버에 Range 로 받음 (slice.c)
+ * 21. -N: 서버의 404, 410 응답과 호스트 이름 조회 실패를 이 기간 (초, 기본 0)
+ *     동안 캐시와 따로 기억해, 같은 요청은 서버에 가지 않고 바로 같은 응답
+ *     (조회 실패는 502) 으로 실패시킴 (neg.c)
  */
 int main(int argc, char **argv) {
-    int listenfd, *clientfdp;           // 서버 소켓, 클라이언트 소켓 포인터
-    socklen_t clientlen;                // 클라이언트 주소 구조체 크기
-    struct sockaddr_storage clientaddr; // 클라이언트 주소 정보
-    pthread_t tid;                      // 스레드 ID
+    int opt;
+    int reuseport = 0;                  // CPU 별 SO_REUSEPORT 샤딩 여부
+    char *cpulist = NULL;               // 워커를 고정할 CPU 목록 (-c)
+    int max_inflight = 0, max_pending = 0, mem_budget_mb = 0;  // 진입 한도 (0이면 없음)
+    int max_limit = 0;                  // 자동 조절 동시성 한도의 상한 (0이면 끔)
+    int nmiss = 0;                      // 미스 차선 워커 수 (0이면 차선을 나누지 않음)
+    long cache_size = MAX_CACHE_SIZE;   // 캐시 용량 (-C)
+    long object_size = MAX_OBJECT_SIZE; // 객체 하나의 최대 크기 (-O)
+    int cache_shards = 0;               // 캐시 샤드 수 (-K, 0이면 자동)
+    int cache_pol = CACHE_LRU;          // 캐시 정책 (-E)
+    long default_ttl = -1;              // 신선도 헤더가 없을 때의 신선 기간 (-T, -1 이면 기본값)
+    long default_swr = -1;              // 재검증 유예 기간 기본값 (-V, -1 이면 기본값)
+    long default_sie = -1;              // 오류 시 만료 사본 기간 기본값 (-X, -1 이면 기본값)
+    long slice = 0;                     // 큰 응답을 나눌 조각 크기 (-Z, 0 이면 나누지 않음)
+    long neg_ttl = 0;                   // 실패를 기억할 기간 (-N, 0 이면 기억하지 않음)
+    shard_t sh;
 
-    /* 명령행 인수 검사: 프로그램명 + 포트번호 = 2개 */
-    if (argc != 2) {
-        fprintf(stderr, "usage: %s <port>\n", argv[0]);
-        exit(1);
+    /* 명령행 옵션 파싱 */
+    while ((opt = getopt(argc, argv, "m:n:q:rS:c:L:P:M:A:W:C:O:K:E:T:V:X:Z:N:")) != -1) {
+        switch (opt) {
+        case 'm':
+            if (!strcmp(optarg, "thread"))
+                mode = MODE_THREAD;
+            else if (!strcmp(optarg, "pool"))
+                mode = MODE_POOL;
+            else if (!strcmp(optarg, "epoll"))
+                mode = MODE_EPOLL;
+            else if (!strcmp(optarg, "uring"))
+                mode = MODE_URING;
+            else if (!strcmp(optarg, "coro"))
+                mode = MODE_CORO;
+            else if (!strcmp(optarg, "steal"))
+                mode = MODE_STEAL;
+            else
+                usage(argv[0]);
+            break;
+        case 'n':
+            nthreads = atoi(optarg);
+            break;
+        case 'q':
+            sbufsize = atoi(optarg);
+            break;
+        case 'r':
+            reuseport = 1;
+            break;
+        case 'S':
+            stats_interval = atoi(optarg);
+            break;
+        case 'c':
+            cpulist = optarg;
+            break;
+        case 'L':
+            max_inflight = atoi(optarg);
+            break;
+        case 'P':
+            max_pending = atoi(optarg);
+            break;
+        case 'M':
+            mem_budget_mb = atoi(optarg);
+            break;
+        case 'A':
+            max_limit = atoi(optarg);
+            break;
+        case 'W':
+            nmiss = atoi(optarg);
+            break;
+        case 'C':
+            cache_size = parse_size(optarg);
+            break;
+        case 'O':
+            object_size = parse_size(optarg);
+            break;
+        case 'K':
+            cache_shards = atoi(optarg);
+            break;
+        case 'E':
+            if ((cache_pol = cache_policy(optarg)) < 0)
+                usage(argv[0]);
+            break;
+        case 'T':
+            if ((default_ttl = atol(optarg)) < 0)
+                usage(argv[0]);
+            break;
+        case 'V':
+            if ((default_swr = atol(optarg)) < 0)
+                usage(argv[0]);
+            break;
+        case 'X':
+            if ((default_sie = atol(optarg)) < 0)
+                usage(argv[0]);
+            break;
+        case 'Z':
+            slice = parse_size(optarg);
+            break;
+        case 'N':
+            if ((neg_ttl = atol(optarg)) < 0)
+                usage(argv[0]);
+            break;
+        default:
+            usage(argv[0]);
+        }
     }
 
+    /* 남은 인수는 포트번호 1개여야 함 */
+    if (optind != argc - 1 || nthreads < 0 || sbufsize <= 0 ||
+        max_inflight < 0 || max_pending < 0 || mem_budget_mb < 0 || max_limit < 0 || nmiss < 0 ||
+        cache_size < 0 || object_size < 0 || cache_shards < 0 || slice < 0)
+        usage(argv[0]);
+    /* NUMA 구성을 읽고 -c 가 있으면 프로세스를 그 CPU 들로 제한
+     * (-r 샤드도 이 CPU 들에만 만들어짐, 캐시 샤드는 그 노드들에 나뉨) */
+    if (topo_init(cpulist) < 0)
+        exit(1);
+    if (cpulist || reuseport)
+        topo_print(stdout);
+
+    admit_init(max_inflight, max_pending, (long)mem_budget_mb << 20);
+    limit_init(max_limit);
+    cache_init(cache_size, object_size, cache_shards, cache_pol);
+    slice_init(slice);
+    neg_init(neg_ttl, NEG_CACHE_SIZE);
+    if (default_ttl >= 0)
+        fresh_set_default(default_ttl);
+    if (default_swr >= 0)
+        fresh_set_swr_default(default_swr);
+    if (default_sie >= 0)
+        fresh_set_sie_default(default_sie);
+
+    /* 모드별 기본값: -n 만 주면 pool, 스레드 수를 생략하면 코어 수 */
+    if (mode < 0)
+        mode = nthreads > 0 ? MODE_POOL : MODE_THREAD;
+    if (nthreads == 0)
+        nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+
     /* SIGPIPE 신호 무시 설정
      * - 클라이언트가 연결을 끊었을 때 프록시가 종료되지 않도록 함
      * - 소켓에 쓰기 시도 시 발생할 수 있는 신호를 무시
      */
     Signal(SIGPIPE, SIG_IGN);
 
+    /* -W: 미스 전용 워커와 미스 큐 (큐 깊이는 -q 와 같음) */
+    lane_init(nmiss, sbufsize);
+    refresh_init(REFRESH_WORKERS, REFRESH_QUEUE);
+
+    /* -S: 주기적으로 통계를 stderr 에 출력하는 스레드 */
+    if (stats_interval > 0) {
+        pthread_t tid;
+        Pthread_create(&tid, NULL, stats_routine, NULL);
+        Pthread_detach(tid);
+    }
+
+    /* === SO_REUSEPORT 샤딩 ===
+     * 샤드들이 각자 스레드를 띄우므로 main 스레드는 할 일이 없음
+     */
+    if (reuseport) {
+        start_shards(argv[optind]);
+        while (1)
+            Pause();
+    }
+
     /* 지정된 포트에서 클라이언트 연결을 대기하는 소켓 생성 */
-    listenfd = Open_listenfd(argv[1]);
+    sh.listenfd = Open_listenfd(argv[optind]);
+    sh.cpu = -1;
+    sh.nworkers = nthreads;
+
+    /* === epoll 모드 ===
+     * 코어당 이벤트 루프 하나가 논블로킹 소켓으로 여러 연결을 동시에 처리
+     */
+    if (mode == MODE_EPOLL)
+        evloop_run(sh.listenfd, nthreads);
+
+    /* === io_uring 모드 ===
+     * 커널이 io_uring 을 지원하지 않거나 io_uring 없이 빌드했으면 epoll 로 대체
+     */
+    if (mode == MODE_URING) {
+#ifdef HAVE_IO_URING
+        uring_run(sh.listenfd, nthreads);
+#else
+        fprintf(stderr, "built without io_uring (make proxy-uring), falling back to epoll\n");
+        evloop_run(sh.listenfd, nthreads);
+#endif
+    }
+
+    /* === 코루틴 모드 ===
+     * doit 의 블로킹 I/O 가 스레드 대신 코루틴만 재우고 스케줄러로 양보
+     */
+    if (mode == MODE_CORO)
+        coro_run(sh.listenfd, nthreads);
+
+    /* === 작업 훔치기 모드 ===
+     * 워커들이 직접 accept 해서 자기 덱에 넣고, 놀면 서로 훔쳐 감
+     */
+    if (mode == MODE_STEAL) {
+        steal_start(sh.listenfd, nthreads, -1);
+        while (1)
+            Pause();
+    }
+
+    serve(&sh);
+    return 0;
+}
+
+/*
+ * serve - 샤드 하나의 accept 루프 실행 (thread/pool 모드, 반환하지 않음)
+ */
+static void serve(shard_t *sh) {
+    int *clientfdp, connfd;             // 클라이언트 소켓 (포인터)
+    socklen_t clientlen;                // 클라이언트 주소 구조체 크기
+    struct sockaddr_storage clientaddr; // 클라이언트 주소 정보
+    pthread_t tid;                      // 스레드 ID
+    int i;
+
+    /* === 프리스레드 모드 ===
+     * 워커를 부팅 시점에 한 번만 만들고, accept 루프는 연결 소켓을 큐에
+     * 넣기만 한다. 큐가 가득 차면 accept 루프가 대기하므로 스레드 수와
+     * 대기 중인 연결 수 모두 상한이 생긴다.
+     */
+    if (mode == MODE_POOL) {
+        sbuf_init(&sh->sbuf, sbufsize);
+        for (i = 0; i < sh->nworkers; i++) {
+            worker_arg_t *wa = Malloc(sizeof(worker_arg_t));
+            wa->sh = sh;
+            wa->cpu = sh->cpu >= 0 ? sh->cpu : topo_cpu(i);  /* 샤드 CPU 또는 -c 목록 */
+            topo_thread_create(&tid, worker_routine, wa, wa->cpu);
+        }
+
+        while (1) {
+            clientlen = sizeof(clientaddr);
+            connfd = Accept(sh->listenfd, (SA *)&clientaddr, &clientlen);
+            if (admit_accept(connfd))        /* 한도를 넘으면 503 으로 거절 */
+                sbuf_insert(&sh->sbuf, connfd);  /* 빈 슬롯이 없으면 여기서 대기 */
+        }
+    }
     
     /* 무한 루프: 계속해서 클라이언트 연결 수락 */
     while (1) {
@@ -69,11 +412,18 @@ int main(int argc, char **argv) {
         clientfdp = Malloc(sizeof(int));
         
         /* 클라이언트 연결 수락 (블로킹 - 연결이 올 때까지 대기) */
-        *clientfdp = Accept(listenfd, (SA *)&clientaddr, &clientlen);
+        *clientfdp = Accept(sh->listenfd, (SA *)&clientaddr, &clientlen);
+
+        /* 한도를 넘으면 스레드를 만들지 않고 503 으로 바로 거절 */
+        if (!admit_accept(*clientfdp)) {
+            Free(clientfdp);
+            continue;
+        }
         
         /* 새로운 스레드 생성하여 클라이언트 요청 처리
          * - thread_routine: 스레드가 실행할 함수
          * - clientfdp: 스레드에 전달할 인수 (클라이언트 소켓)
+         * - 새 스레드는 accept 스레드의 CPU 고정 설정을 물려받음
          */
         Pthread_create(&tid, NULL, thread_routine, clientfdp);
         
@@ -84,7 +434,113 @@ int main(int argc, char **argv) {
          */
         Pthread_detach(tid);
     }
-    return 0;
+}
+
+/*
+ * start_shards - 사용 가능한 CPU 마다 SO_REUSEPORT 샤드를 하나씩 띄움
+ * 
+ * 커널이 새 연결을 리스닝 소켓들에 나눠 주므로 accept 스레드 하나가
+ * 병목이 되지 않고, 연결을 처리하는 스레드도 같은 CPU 에 머문다.
+ * -n 으로 준 워커 수는 샤드들에 나눠서 배정한다.
+ */
+static void start_shards(char *port) {
+    cpu_set_t allowed;
+    shard_t *shards;
+    pthread_t tid;
+    int cpu, nshards, i = 0;
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0)
+        unix_error("sched_getaffinity error");
+    nshards = CPU_COUNT(&allowed);
+    shards = Calloc(nshards, sizeof(shard_t));
+
+    for (cpu = 0; i < nshards && cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &allowed))
+            continue;
+        shard_t *sh = &shards[i++];
+        sh->listenfd = Open_listenfd_reuseport(port);
+        sh->cpu = cpu;
+        sh->nworkers = (nthreads + nshards - 1) / nshards;
+
+        if (mode == MODE_EPOLL)
+            evloop_start(sh->listenfd, cpu);
+        else if (mode == MODE_CORO)
+            coro_start(sh->listenfd, cpu);
+        else if (mode == MODE_STEAL)
+            steal_start(sh->listenfd, sh->nworkers, cpu);
+        else if (mode == MODE_URING) {
+#ifdef HAVE_IO_URING
+            if (uring_start(sh->listenfd, cpu) < 0) {
+                fprintf(stderr, "io_uring unavailable (%s), falling back to epoll\n",
+                        strerror(errno));
+                evloop_start(sh->listenfd, cpu);
+            }
+#else
+            evloop_start(sh->listenfd, cpu);
+#endif
+        } else {
+            topo_thread_create(&tid, shard_routine, sh, cpu);
+            Pthread_detach(tid);
+        }
+    }
+    printf("%d SO_REUSEPORT shards on port %s\n", nshards, port);
+}
+
+/*
+ * shard_routine - 샤드 전용 accept 스레드 (자기 CPU 에 고정한 뒤 serve 실행)
+ */
+static void *shard_routine(void *vargp) {
+    shard_t *sh = vargp;
+
+    pin_thread(sh->cpu);
+    serve(sh);
+    return NULL;
+}
+
+/*
+ * stats_routine - stats_interval 초마다 모드별 통계를 stderr 에 출력하는 스레드
+ */
+static void *stats_routine(void *vargp) {
+    while (1) {
+        Sleep(stats_interval);
+        admit_stats(stderr);
+        limit_stats(stderr);
+        cache_stats(stderr);
+        flight_stats(stderr);
+        refresh_stats(stderr);
+        slice_stats(stderr);
+        neg_stats(stderr);
+        lane_stats(stderr);
+        if (mode == MODE_STEAL)
+            steal_stats(stderr);
+    }
+    return NULL;
+}
+
+/*
+ * usage - 사용법을 출력하고 종료
+ */
+static void usage(char *prog) {
+    fprintf(stderr, "usage: %s [-m thread|pool|epoll|uring|coro|steal] [-n nthreads] [-q queue] [-r] [-S secs] [-c cpulist] "
+                    "[-L inflight] [-P pending] [-M mbytes] [-A maxlimit] [-W misses] "
+                    "[-C cachesize] [-O maxobject] [-K shards] [-E lru|tinylfu|gdsf] [-T ttl] [-V swr] [-X maxstale] [-Z slice] [-N negttl] <port>\n", prog);
+    exit(1);
+}
+
+/*
+ * parse_size - "512", "64K", "256M", "4G" 같은 크기를 바이트로 변환
+ * 반환값: 바이트 수, 형식이 틀리면 -1
+ */
+static long parse_size(const char *s) {
+    char *end;
+    long n = strtol(s, &end, 10);
+
+    switch (*end) {
+    case 'g': case 'G': n <<= 10; /* fall through */
+    case 'm': case 'M': n <<= 10; /* fall through */
+    case 'k': case 'K': n <<= 10; end++; break;
+    }
+    return end == s || *end != '\0' ? -1 : n;
 }
 
 /*
@@ -109,134 +565,1110 @@ void *thread_routine(void *vargp) {
     Free(vargp);
     
     /* 실제 HTTP 요청 처리 함수 호출 */
+    admit_begin();
     doit(clientfd);
     
     /* 클라이언트와의 연결 종료 */
     Close(clientfd);
+    admit_end();
     
     return NULL;  // 스레드 종료
 }
 
+/*
+ * worker_routine - 프리스레드 모드의 워커 스레드 함수
+ * 
+ * 매개변수: vargp - 워커가 속한 샤드와 고정할 CPU (worker_arg_t *)
+ * 
+ * 샤드의 연결 큐에서 소켓을 하나씩 꺼내 처리하는 일을 영원히 반복한다.
+ * 스레드를 재사용하므로 연결마다 생성/소멸 비용이 들지 않는다.
+ */
+void *worker_routine(void *vargp) {
+    shard_t *sh = ((worker_arg_t *)vargp)->sh;
+
+    Pthread_detach(pthread_self());
+    pin_thread(((worker_arg_t *)vargp)->cpu);
+    Free(vargp);
+    while (1) {
+        int clientfd = sbuf_remove(&sh->sbuf);  /* 큐가 비어 있으면 대기 */
+        admit_begin();
+        doit(clientfd);
+        Close(clientfd);
+        admit_end();
+    }
+}
+
 /*
  * doit - HTTP 요청을 처리하는 핵심 함수
  * 
  * 매개변수: clientfd - 클라이언트와 연결된 소켓 파일 디스크립터
  * 
  * 처리 과정:
- * 1. 클라이언트 요청 읽기 및 파싱
- * 2. 목적지 서버에 연결
- * 3. HTTP 요청을 서버에 전달
- * 4. 서버 응답을 클라이언트에 중계
+ * 1. 클라이언트 요청 라인 읽기 및 파싱
+ * 2. 캐시 확인: 적중이면 캐시된 응답을 바로 보냄 (서버에 가지 않음)
+ *    클라이언트의 조건부 요청이 맞으면 304, HEAD 면 헤더만 보냄
+ * 3. 미스면 serve_miss 가 서버에 요청을 전달하고 응답을 중계
+ *    (-W 를 줬으면 미스 차선으로 넘기고 바로 돌아옴)
  */
 void doit(int clientfd) {
-    rio_t rio_client, rio_server;       // RIO 버퍼 (클라이언트용, 서버용)
+    request_t *req;                     // 파싱한 요청 (미스 차선으로 넘어갈 수 있음)
     char buf[MAXLINE];                  // 범용 버퍼
-    char method[MAXLINE], uri[MAXLINE], version[MAXLINE]; // HTTP 요청 라인 구성 요소
-    char hostname[MAXLINE], path[MAXLINE], portstr[8];    // URI 파싱 결과
-    int serverfd, port;                 // 서버 소켓, 포트 번호
+    char method[MAXLINE], version[MAXLINE]; // HTTP 요청 라인 구성 요소
+    cobj_t *obj;                        // 캐시 적중 객체
+    int usable = 0;                     // 캐시 사본을 바로 보내도 되는지
+    size_t n;
+    int fd;
 
     /* === 1단계: 클라이언트 요청 읽기 === */
     
     /* 클라이언트 소켓에 대한 RIO 버퍼 초기화 */
-    Rio_readinitb(&rio_client, clientfd);
+    req = Malloc(sizeof(request_t));
+    req->clientfd = clientfd;
+    req->stale = NULL;
+    req->hdr_end = 0;
+    req->if_none_match[0] = req->if_modified_since[0] = '\0';
+    req->range[0] = req->if_range[0] = '\0';
+    req->auth = req->cookie = req->solo = 0;
+    req->client_gone = 0;
+    Rio_readinitb(&req->rio, clientfd);
     
     /* HTTP 요청의 첫 번째 줄(요청 라인) 읽기
      * 형식: "GET http://www.example.com/path HTTP/1.1"
      */
-    if (!Rio_readlineb(&rio_client, buf, MAXLINE))
+    if (rio_readlineb(&req->rio, buf, MAXLINE) <= 0) {
+        Free(req);
         return;  // 읽기 실패 시 함수 종료
+    }
+    req->start = limit_now();
 
     printf("Request line: %s", buf);  // 디버깅용 출력
     
     /* 요청 라인을 메소드, URI, 버전으로 분리
      * 예: "GET", "http://www.example.com/path", "HTTP/1.1"
      */
-    sscanf(buf, "%s %s %s", method, uri, version);
+    sscanf(buf, "%s %s %s", method, req->uri, version);
 
-    /* GET 메소드만 지원 (POST, PUT 등은 처리하지 않음) */
-    if (strcasecmp(method, "GET")) {
-        printf("Only GET supported\n");
+    /* GET, HEAD 메소드만 지원 (POST, PUT 등은 처리하지 않음)
+     * HEAD 도 서버에는 GET 으로 보내 캐시를 채우고, 클라이언트에는 헤더만 보낸다 */
+    if (strcasecmp(method, "GET") && strcasecmp(method, "HEAD")) {
+        printf("Only GET and HEAD supported\n");
+        Free(req);
         return;
     }
+    req->head = !strcasecmp(method, "HEAD");
 
-    /* === 2단계: URI 파싱 === */
-    
     /* URI에서 호스트명, 경로, 포트 번호 추출
      * 예: "http://www.example.com:8080/path" → 
      *     hostname="www.example.com", port=8080, path="/path"
      */
-    parse_uri(uri, hostname, path, &port);
+    parse_uri(req->uri, req->hostname, req->path, &req->port);
+
+    /* 나머지 요청 헤더를 모두 읽음 (조건부 요청, Range 는 따로 보관) */
+    read_req_hdrs(req);
+
+    /* === 2단계: 캐시 확인 (URI 로 찾음) ===
+     * 만료된 객체는 미스로 처리하되 서버에 재검증하도록 요청에 붙여 둔다.
+     * 재검증 유예 기간 안이면 만료 사본을 바로 보내고 재검증은 백그라운드에 맡긴다.
+     */
+    if ((obj = cache_lookup(req->uri, req->hdrs, req->hdrs_len)) != NULL) {
+        if (cache_fresh(obj)) {
+            usable = 1;
+        } else if (cache_stale_ok(obj)) {
+            refresh_submit(req, obj);
+            usable = 1;
+        }
+        if (!usable) {
+            req->stale = obj;
+        } else {
+            serve_hit(req, obj);
+            cache_release(obj);
+            lane_record(1, limit_now() - req->start);
+            Free(req);
+            return;
+        }
+    }
+
+    /* 최근에 404, 410 이었거나 호스트 이름을 찾지 못한 요청은 서버에 가지 않고
+     * 기억해 둔 응답으로 바로 실패 (-N) */
+    if ((n = neg_lookup(req->uri, req->hostname, buf, sizeof(buf))) > 0) {
+        send_client(req, buf, n);
+        lane_record(1, limit_now() - req->start);
+        request_free(req);
+        return;
+    }
 
-    /* === 3단계: 목적지 서버에 연결 === */
+    /* === 3단계: 미스 ===
+     * -W: 미스 차선으로 넘기고 이 워커는 다음 연결로 돌아감.
+     * 호출한 쪽이 clientfd 를 닫으므로 복제한 소켓을 넘긴다.
+     * 코루틴 안에서는 (논블로킹 소켓) 넘기지 않고 직접 처리한다.
+     */
+    if (lane_enabled() && io_wait_hook == NULL) {
+        if ((fd = dup(clientfd)) >= 0) {
+            req->clientfd = req->rio.rio_fd = fd;
+            if (lane_submit(req))
+                return;
+            close(fd);
+        }
+        admit_send_busy(clientfd);  /* 미스 큐가 가득 참: 적중 차선은 기다리지 않음 */
+        request_free(req);
+        return;
+    }
+    serve_miss(req);
+    request_free(req);
+}
+
+/*
+ * request_free - 요청과 요청이 잡고 있던 만료 객체의 참조를 놓음
+ */
+void request_free(request_t *req) {
+    if (req->stale)
+        cache_release(req->stale);
+    Free(req);
+}
+
+/*
+ * serve_hit - 캐시된 응답을 클라이언트에 보냄
+ * 
+ * 조건부 요청이 캐시 객체의 검증자와 맞으면 본문 없이 304 를 보낸다.
+ * Range 요청이면 캐시된 본문을 잘라 206 으로 보낸다 (서버에 가지 않음).
+ * 재검증 유예 기간의 만료 사본이면 Warning, Age 를 붙여 보낸다.
+ */
+static void serve_hit(request_t *req, cobj_t *obj) {
+    if (fresh_match(req->if_none_match, req->if_modified_since, obj->etag, obj->last_modified))
+        send_not_modified(req, obj);
+    else
+        send_cached(req, obj);
+}
+
+/*
+ * send_client - 응답 조각을 클라이언트에 보냄
+ *
+ * HEAD 요청이면 헤더 끝 빈 줄까지만 보내고 본문은 버린다. 조각이 어디서
+ * 나뉘어도 되도록 "\r\n\r\n" 을 몇 글자째 맞췄는지 req->hdr_end 에 기억한다.
+ */
+static void send_client(request_t *req, const char *buf, size_t n) {
+    size_t i;
+
+    if (req->head) {
+        for (i = 0; i < n && req->hdr_end < 4; i++) {
+            if (buf[i] == "\r\n\r\n"[req->hdr_end])
+                req->hdr_end++;
+            else
+                req->hdr_end = buf[i] == '\r';
+        }
+        n = i;
+    }
+    /* 클라이언트가 끊었으면 (EPIPE, RST) 더 보내지 않음. Rio_writen 은 프로세스를
+     * 끝내므로 쓰지 않는다: 리더는 따라 받는 요청들과 캐시를 위해 응답을
+     * 끝까지 받아야 함 */
+    if (n > 0 && !req->client_gone && rio_writen(req->clientfd, (void *)buf, n) < 0)
+        req->client_gone = 1;
+}
+
+/*
+ * send_not_modified - 캐시 객체의 검증자와 캐시 관련 헤더만 담은 304 를 보냄
+ */
+static void send_not_modified(request_t *req, cobj_t *obj) {
+    static const char *keep[] = { "ETag:", "Last-Modified:", "Cache-Control:", "Expires:",
+                                  "Vary:", "Content-Location:", "Date:", NULL };
+    char buf[MAXBUF];
+    const char *p = obj->data, *end = obj->data + obj->size, *eol;
+    size_t len, n;
+    int i;
+
+    len = sprintf(buf, "HTTP/1.0 304 Not Modified\r\n");
+    if (!cache_fresh(obj))
+        len += sprintf(buf + len, "Warning: %s\r\nAge: %ld\r\n", WARN_STALE, cache_age(obj));
+    if ((eol = memchr(p, '\n', end - p)) != NULL)
+        p = eol + 1;                    /* 상태 줄은 건너뜀 */
+    while (p < end && *p != '\r' && *p != '\n' && (eol = memchr(p, '\n', end - p)) != NULL) {
+        n = eol + 1 - p;
+        for (i = 0; keep[i]; i++) {
+            if (!strncasecmp(p, keep[i], strlen(keep[i])) && len + n + 2 <= sizeof(buf)) {
+                memcpy(buf + len, p, n);
+                len += n;
+                break;
+            }
+        }
+        p += n;
+    }
+    memcpy(buf + len, "\r\n", 2);
+    send_client(req, buf, len + 2);
+}
+
+/*
+ * serve_stale - 서버에서 응답을 받지 못했을 때 (연결 실패, 시간 초과, 5xx)
+ * 재검증하려던 만료 사본을 대신 보냄
+ *
+ * 매개변수:
+ * - f: 이 요청이 리더인 fetch (따라 받는 요청들에게도 같은 사본을 보냄)
+ *
+ * stale-if-error 기간 (-X) 안일 때만 보낸다.
+ * 반환값: 보냈으면 1
+ */
+static int serve_stale(request_t *req, flight_t *f) {
+    if (req->clientfd < 0 || !req->stale || !cache_error_ok(req->stale))
+        return 0;
+    printf("Origin failed, serving stale copy\n");
+    send_stale(req, f, req->stale, WARN_REVALIDATE_FAILED);
+    return 1;
+}
+
+/* send_part - 응답 조각을 클라이언트(있을 때)와 flight(있을 때)에 보냄 */
+static void send_part(request_t *req, flight_t *f, const char *buf, size_t n) {
+    if (req->clientfd >= 0)
+        send_client(req, buf, n);
+    if (f)
+        flight_append(f, buf, n);
+}
+
+/* hdr_in - 헤더 줄이 names (NULL 로 끝남) 의 이름 중 하나로 시작하는지 */
+static int hdr_in(const char *line, const char **names) {
+    int i;
+
+    for (i = 0; names[i]; i++)
+        if (!strncasecmp(line, names[i], strlen(names[i])))
+            return 1;
+    return 0;
+}
+
+/*
+ * send_head - 캐시된 응답의 헤더 블록을 고쳐서 보냄 (마지막 빈 줄은 빼고)
+ *
+ * 매개변수:
+ * - status: 대신 보낼 상태 줄 (NULL 이면 캐시된 상태 줄 그대로)
+ * - extra: 상태 줄 바로 다음에 넣을 헤더들
+ * - drop: 캐시된 헤더 가운데 빼고 보낼 것들의 이름
+ *
+ * 반환값: 헤더 끝 빈 줄의 위치 (그 뒤가 본문)
+ */
+static const char *send_head(request_t *req, flight_t *f, cobj_t *obj, const char *status,
+                             const char *extra, const char **drop) {
+    const char *p = obj->data, *end = obj->data + obj->size, *eol;
+    size_t n;
+
+    if ((eol = memchr(p, '\n', end - p)) == NULL)
+        return p;
+    n = eol + 1 - p;
+    if (status)
+        send_part(req, f, status, strlen(status));
+    else
+        send_part(req, f, p, n);
+    p += n;
+    send_part(req, f, extra, strlen(extra));
+    while (p < end && *p != '\r' && *p != '\n' && (eol = memchr(p, '\n', end - p)) != NULL) {
+        n = eol + 1 - p;
+        if (!hdr_in(p, drop))
+            send_part(req, f, p, n);
+        p += n;
+    }
+    return p;
+}
+
+/* body_of - 헤더 끝 빈 줄 p 다음, 본문이 시작하는 곳 */
+static const char *body_of(const char *p, const char *end) {
+    const char *eol = memchr(p, '\n', end - p);
+
+    return eol ? eol + 1 : end;
+}
+
+/*
+ * send_stale - 캐시된 응답을 상태 줄 다음에 Warning 과 Age 를 넣어서 보냄
+ * (서버가 보낸 Age 헤더는 빼고, 나머지 헤더와 본문은 그대로)
+ */
+static void send_stale(request_t *req, flight_t *f, cobj_t *obj, const char *warning) {
+    static const char *drop[] = { "Age:", NULL };
+    char extra[MAXLINE];
+    const char *p;
+
+    snprintf(extra, sizeof(extra), "Warning: %s\r\nAge: %ld\r\n", warning, cache_age(obj));
+    p = send_head(req, f, obj, NULL, extra, drop);
+    send_part(req, f, p, obj->data + obj->size - p);     /* 빈 줄과 본문 */
+}
+
+/* obj_body - 캐시된 응답에서 본문이 시작하는 곳 */
+static const char *obj_body(cobj_t *obj) {
+    const char *p = obj->data, *end = obj->data + obj->size;
+
+    while (p < end && *p != '\r' && *p != '\n')      /* 헤더 끝 빈 줄을 찾음 */
+        p = body_of(p, end);
+    return body_of(p, end);
+}
+
+/* 본문의 [first, last] 바이트를 클라이언트에 보내는 함수 (실패하면 -1) */
+typedef int (*span_fn)(request_t *req, cobj_t *obj, size_t first, size_t last);
+
+/* send_span - 캐시 객체에 통째로 든 본문의 [first, last] 를 보냄 */
+static int send_span(request_t *req, cobj_t *obj, size_t first, size_t last) {
+    send_client(req, obj_body(obj) + first, last - first + 1);
+    return 0;
+}
+
+/*
+ * range_applies - 요청의 Range 를 캐시 객체에 적용할지
+ *
+ * GET 에만 적용한다. If-Range 가 있으면 그 검증자가 객체와 정확히 같을
+ * 때만 (ETag 는 강한 비교, 날짜는 Last-Modified 와 같은 문자열) 적용하고,
+ * 다르면 전체를 보낸다.
+ */
+static int range_applies(request_t *req, cobj_t *obj) {
+    const char *v = req->if_range;
+
+    if (!req->range[0] || req->head)
+        return 0;
+    if (!v[0])
+        return 1;
+    if (v[0] == '"' || !strncmp(v, "W/", 2))
+        return obj->etag && obj->etag[0] == '"' && !strcmp(v, obj->etag);
+    return obj->last_modified && !strcmp(v, obj->last_modified);
+}
+
+/*
+ * send_range - Range 요청에 캐시된 본문을 잘라 206 으로 답함
+ *
+ * 매개변수:
+ * - obj: 헤더를 가져올 캐시 객체 (조각 캐시면 헤더 객체)
+ * - len: 본문 전체 크기
+ * - span: 구간의 본문을 보내는 함수 (send_span 이나 조각을 모으는 send_slices)
+ *
+ * 구간이 하나면 Content-Range 와 그 구간만, 여럿이면 구간마다
+ * Content-Type 과 Content-Range 를 붙인 multipart/byteranges 로 보낸다.
+ * 만족하는 구간이 없으면 416.
+ * 반환값: Range 를 적용해 답했으면 1, 전체를 보내야 하면 0
+ */
+static int send_range(request_t *req, cobj_t *obj, size_t len, span_fn span) {
+    static const char *drop_single[] = { "Content-length:", "Content-Range:", "Age:", NULL };
+    static const char *drop_multi[] = { "Content-length:", "Content-Range:", "Content-Type:", "Age:", NULL };
+    range_t r[RANGE_MAX];
+    char extra[MAXLINE], part[MAXLINE], ctype[MAXLINE], boundary[32];
+    const char *end = obj->data + obj->size, *p;
+    size_t total, n, wlen = 0;
+    int nr, i;
+
+    if (!range_applies(req, obj))
+        return 0;
+    if ((nr = range_parse(req->range, len, r)) < 0)
+        return 0;
+    if (nr == 0) {
+        n = snprintf(extra, sizeof(extra), "HTTP/1.0 416 Range Not Satisfiable\r\n"
+                     "Content-Range: bytes */%zu\r\nContent-length: 0\r\n\r\n", len);
+        send_client(req, extra, n);
+        return 1;
+    }
+
+    if (!cache_fresh(obj))
+        wlen = snprintf(extra, sizeof(extra), "Warning: %s\r\nAge: %ld\r\n", WARN_STALE, cache_age(obj));
+    if (nr == 1) {
+        snprintf(extra + wlen, sizeof(extra) - wlen, "Content-Range: bytes %zu-%zu/%zu\r\nContent-length: %zu\r\n",
+                 r[0].first, r[0].last, len, r[0].last - r[0].first + 1);
+        send_head(req, NULL, obj, "HTTP/1.0 206 Partial Content\r\n", extra, drop_single);
+        send_client(req, "\r\n", 2);
+        span(req, obj, r[0].first, r[0].last);
+        return 1;
+    }
+
+    /* multipart: 전체 길이를 먼저 계산 */
+    ctype[0] = '\0';
+    for (p = obj->data; p < end && *p != '\r' && *p != '\n'; p = body_of(p, end)) {
+        if (!strncasecmp(p, "Content-Type:", 13)) {
+            n = strcspn(p, "\r\n");
+            snprintf(ctype, sizeof(ctype), "%.*s\r\n", (int)n, p);
+        }
+    }
+    sprintf(boundary, "%08x%08zx", obj->hash, obj->size);
+    total = strlen(boundary) + 8;                       /* "\r\n--" boundary "--\r\n" */
+    for (i = 0; i < nr; i++)
+        total += snprintf(part, sizeof(part), "\r\n--%s\r\n%sContent-Range: bytes %zu-%zu/%zu\r\n\r\n",
+                          boundary, ctype, r[i].first, r[i].last, len) + r[i].last - r[i].first + 1;
+    snprintf(extra + wlen, sizeof(extra) - wlen, "Content-Type: multipart/byteranges; boundary=%s\r\n"
+             "Content-length: %zu\r\n", boundary, total);
+    send_head(req, NULL, obj, "HTTP/1.0 206 Partial Content\r\n", extra, drop_multi);
+    send_client(req, "\r\n", 2);
+    for (i = 0; i < nr; i++) {
+        n = snprintf(part, sizeof(part), "\r\n--%s\r\n%sContent-Range: bytes %zu-%zu/%zu\r\n\r\n",
+                     boundary, ctype, r[i].first, r[i].last, len);
+        send_client(req, part, n);
+        if (span(req, obj, r[i].first, r[i].last) < 0)
+            return 1;                   /* 조각을 받지 못함: 응답이 잘린 채 끝남 */
+    }
+    n = snprintf(part, sizeof(part), "\r\n--%s--\r\n", boundary);
+    send_client(req, part, n);
+    return 1;
+}
+
+/*
+ * send_cached - 캐시 객체를 클라이언트에 보냄 (Range 가 있으면 잘라서 206,
+ * 재검증 유예 기간의 만료 사본이면 Warning, Age 를 붙임)
+ */
+static void send_cached(request_t *req, cobj_t *obj) {
+    if (send_range(req, obj, obj->data + obj->size - obj_body(obj), send_span))
+        return;
+    if (cache_fresh(obj))
+        send_client(req, obj->data, obj->size);
+    else
+        send_stale(req, NULL, obj, WARN_STALE);
+}
+
+/*
+ * fetch_slice - 캐시에 없는 조각 하나를 서버에 Range 로 받아 buf 에 채우고 캐시에 넣음
+ *
+ * 매개변수:
+ * - head: 조각들의 헤더 객체 (If-Range 로 보낼 검증자와 조각에 붙일 신선도)
+ * - key: 조각의 캐시 키 (같은 조각의 동시 미스는 flight 로 모음)
+ * - off, n: 조각이 본문에서 시작하는 위치와 크기
+ *
+ * 서버가 정확히 그 구간의 206 으로 답하지 않으면 실패다. 응답이 바뀌어
+ * 200 이 왔으면 헤더 객체를 만료시켜 다음 요청이 전체를 다시 받게 한다.
+ * 반환값: 성공하면 0, 실패하면 -1
+ */
+static int fetch_slice(request_t *req, cobj_t *head, const char *key, size_t off, size_t n, char *buf) {
+    rio_t rio_server;
+    char line[MAXLINE], portstr[8];
+    char hkey[MAXLINE + SLICE_KEY_EXTRA];
+    flight_t *f;
+    freader_t follow;
+    cmeta_t meta;
+    size_t got = 0, first = 0, last = 0;
+    ssize_t m = 0;
+    long start;
+    int serverfd, status = 0, ok, failed;
+
+    if ((f = flight_join(key, &follow)) == NULL) {
+        while (got < n && (m = flight_read(&follow, buf + got, n - got)) > 0)
+            got += m;
+        flight_leave(&follow);
+        return got == n ? 0 : -1;
+    }
+    if (!limit_acquire(io_wait_hook == NULL)) {
+        flight_finish(f);
+        slice_count_fetch(0);
+        return -1;
+    }
+    start = limit_now();
+    sprintf(portstr, "%d", req->port);
+    if ((serverfd = open_clientfd(req->hostname, portstr)) < 0) {
+        limit_release();
+        flight_finish(f);
+        slice_count_fetch(0);
+        return -1;
+    }
+    Rio_readinitb(&rio_server, serverfd);
+
+    /* 요청: 클라이언트 헤더 (조건부 요청, Range 는 빼고) + 조각 구간 + If-Range
+     * (서버가 끊으면 쓰기 실패를 읽기 실패와 같이 처리) */
+    sprintf(line, "GET %.*s HTTP/1.0\r\n", MAXLINE - 32, req->path);
+    failed = rio_writen(serverfd, line, strlen(line)) < 0;
+    failed |= forward_hdrs(serverfd, req, 1) < 0;
+    sprintf(line, "Range: bytes=%zu-%zu\r\n", off, off + n - 1);
+    failed |= rio_writen(serverfd, line, strlen(line)) < 0;
+    if (head->etag && head->etag[0] == '"')
+        snprintf(line, MAXLINE, "If-Range: %s\r\n", head->etag);
+    else if (head->last_modified)
+        snprintf(line, MAXLINE, "If-Range: %s\r\n", head->last_modified);
+    else
+        line[0] = '\0';
+    failed |= rio_writen(serverfd, line, strlen(line)) < 0;
+    m = request_tail(line);
+    failed |= rio_writen(serverfd, line, m) < 0;
+
+    /* 응답: 206 과 요청한 구간의 Content-Range 를 확인하고 본문만 받음 */
+    while (!failed && (m = rio_readlineb(&rio_server, line, MAXLINE)) > 0 && strcmp(line, "\r\n")) {
+        if (start) {
+            limit_sample(limit_now() - start);
+            start = 0;
+            sscanf(line, "%*s %d", &status);
+        } else if (!strncasecmp(line, "Content-Range:", 14)) {
+            sscanf(line + 14, " bytes %zu-%zu", &first, &last);
+        }
+    }
+    if (m > 0 && status == 206 && first == off && last == off + n - 1) {
+        flight_share(f, 1);
+        while (got < n && (m = rio_readsomeb(&rio_server, buf + got, n - got)) > 0) {
+            flight_append(f, buf + got, m);
+            got += m;
+        }
+    }
+    Close(serverfd);
+    limit_release();
+
+    meta.expires = head->expires;
+    meta.swr = head->swr;
+    meta.sie = head->sie;
+    meta.etag = head->etag;
+    meta.last_modified = head->last_modified;
+    meta.vary = meta.vkey = NULL;
+    if ((ok = got == n)) {
+        cache_insert(key, buf, n, &meta);
+        cache_count_miss(n);
+    } else if (status == 200) {
+        meta.expires = 0;
+        slice_key(req->uri, -1, hkey);
+        cache_insert(hkey, head->data, head->size, &meta);
+    }
+    flight_finish(f);
+    slice_count_fetch(ok);
+    return ok ? 0 : -1;
+}
+
+/*
+ * send_slices - 조각으로 나눠 캐시된 본문의 [first, last] 를 조각들로 모아 보냄
+ *
+ * 조각마다 캐시에서 찾고, 없거나 헤더 객체와 다른 응답의 조각이면
+ * 서버에서 그 조각만 받는다 (fetch_slice). 조각 하나를 받지 못하면
+ * 거기서 멈춘다 (클라이언트에는 잘린 응답).
+ * 반환값: 다 보냈으면 0, 실패하면 -1
+ */
+static int send_slices(request_t *req, cobj_t *head, size_t first, size_t last) {
+    char key[MAXLINE + SLICE_KEY_EXTRA];
+    char *buf = NULL;                   /* 서버에서 받은 조각 (처음 필요할 때 할당) */
+    size_t size = slice_size(), len = slice_length(head), off, n, a, b;
+    const char *data;
+    cobj_t *s;
+    int ret = 0;
+
+    for (off = first / size * size; off <= last; off += size) {
+        n = len - off < size ? len - off : size;
+        slice_key(req->uri, off / size, key);
+        if ((s = cache_lookup(key, NULL, 0)) != NULL && (s->size != n || !slice_valid(head, s))) {
+            cache_release(s);
+            s = NULL;
+        }
+        if (s) {
+            data = s->data;
+        } else {
+            if (!buf)
+                buf = Malloc(size);
+            if (fetch_slice(req, head, key, off, n, buf) < 0) {
+                ret = -1;
+                break;
+            }
+            data = buf;
+        }
+        a = first > off ? first - off : 0;
+        b = last < off + n - 1 ? last - off : n - 1;
+        send_client(req, data + a, b - a + 1);
+        if (s)
+            cache_release(s);
+    }
+    if (buf)
+        Free(buf);
+    return ret;
+}
+
+/*
+ * serve_sliced - 조각으로 나눠 캐시된 큰 응답을 헤더 객체와 조각들로 조립해 보냄
+ *
+ * 조건부 요청이 헤더 객체의 검증자와 맞으면 304, Range 요청이면 그 구간이
+ * 걸친 조각들만으로 206 을 보낸다. HEAD 면 조각은 보지 않는다.
+ */
+static void serve_sliced(request_t *req, cobj_t *head) {
+    long len = slice_length(head);
+
+    if (fresh_match(req->if_none_match, req->if_modified_since, head->etag, head->last_modified)) {
+        send_not_modified(req, head);
+        return;
+    }
+    if (send_range(req, head, len, send_slices))
+        return;
+    send_client(req, head->data, head->size);
+    if (!req->head)
+        send_slices(req, head, 0, len - 1);
+}
+
+/*
+ * serve_miss - 서버에 요청을 전달하고 응답을 중계하면서 캐시를 채움
+ * 
+ * 매개변수: req - 요청 라인과 헤더를 읽고 파싱한 요청
+ * 
+ * 처리 과정:
+ * 0. 같은 URI 를 이미 가져오는 요청(리더)이 있으면 그 응답을 따라 받음 (flight.c)
+ *    Range 를 서버에 그대로 보내는 요청은 같은 구간을 요청한 것끼리만 모음
+ * 1. 목적지 서버에 연결
+ * 2. HTTP 요청을 서버에 전달 (만료된 캐시 객체가 있으면 그 검증자를 붙여 재검증)
+ * 3. 서버 응답을 받는 대로 클라이언트와 따라 받는 요청들에 중계
+ *    (200 이고 끝까지 받았고 저장 가능하고 cache_max_object 이하면 캐시에 저장)
+ *    재검증에 304 가 오면 캐시된 본문을 보내고 신선 기간만 늘림
+ *    서버가 구간(206)으로 답했고 전체가 캐시에 들어갈 크기면 전체를
+ *    백그라운드로 받아 두어 다음 Range 요청부터는 캐시에서 자름
+ *
+ * req->clientfd 가 -1 이면 클라이언트 없이 캐시만 채우는 백그라운드
+ * 요청이다 (refresh.c). 응답은 캐시와 따라 받는 요청들에게만 보낸다.
+ */
+void serve_miss(request_t *req) {
+    rio_t rio_server;                   // 서버용 RIO 버퍼
+    char buf[MAXLINE];                  // 범용 버퍼
+    char key[MAXLINE + REQUEST_COND_MAX + VARY_MAX + 48];  // flight 키 (URI, 변형, Range 를 보내면 구간도)
+    char fields[VARY_MAX], vkey[VARY_MAX];      // 이 URI 의 Vary 이름 목록과 요청의 변형 키
+    char portstr[8];                    // 포트 번호 문자열
+    int serverfd;                       // 서버 소켓
+    ssize_t n;
+    long start;                         // 서버 작업 시작 시각 (지연 측정용)
+    flight_t *f;                        // 이 요청이 리더인 fetch
+    freader_t follow;                   // 따라 받을 때의 읽기 위치
+    cobj_t *hit;
+    cobj_t *stale = req->stale;         // 재검증할 만료 객체 (없으면 NULL)
+    const char *obj;                    // 캐시에 넣을 응답 사본
+    size_t objlen;
+    fresh_t fr;                         // 응답 헤더의 신선도와 검증자
+    cmeta_t meta;
+    size_t total = 0;                   // 클라이언트에 보낸 응답 바이트
+    long clen = -1, body = 0;           // Content-length (-1 이면 없음), 받은 본문 바이트
+    long rtotal = -1;                   // 206 의 Content-Range 가 알려 준 전체 크기
+    int status = 0, hdrs_done = 0, in_body, not_modified = 0;
+    int vary_known;                     // cache_vary: 1 Vary 있음, 0 없음, -1 캐시에 없음
+    int bg = req->clientfd < 0;         // 백그라운드 요청 (보낼 클라이언트 없음)
+    int fallback;                       // 서버가 실패하면 만료 사본을 대신 보낼 수 있음
+    int failed;                         // 서버에 요청을 보내다 실패함
+    /* 재검증하거나 백그라운드로 받을 때는 전체를 받으므로 클라이언트의
+     * 조건부 요청과 Range 를 서버에 보내지 않음 (캐시가 직접 답함) */
+    int strip = stale || bg;
+    slicer_t sl;                        // 큰 응답을 조각으로 나눠 넣음 (-Z)
+
+    /* 조각으로 나눠 캐시된 큰 응답이면 조각들로 답함 (slice.c) */
+    if (!bg && slice_size()) {
+        slice_key(req->uri, -1, key);
+        if ((hit = cache_peek(key, NULL, 0)) != NULL) {
+            if (cache_fresh(hit)) {
+                serve_sliced(req, hit);
+                cache_release(hit);
+                lane_record(0, limit_now() - req->start);
+                return;
+            }
+            cache_release(hit);
+        }
+    }
+
+    /* === 0단계: 같은 URI 의 동시 미스는 서버 요청 하나로 모음 ===
+     * 백그라운드 요청은 이미 가져오는 중이면 그 리더에게 맡김 */
+    n = snprintf(key, sizeof(key), "%s", req->uri);
+    if (req->range[0] && !strip)
+        n += snprintf(key + n, sizeof(key) - n, " range=%s", req->range);
+    /* Vary 로 나뉘는 URI 는 같은 변형을 요청한 것끼리만 모음. 캐시에 없어
+     * 아직 모르면 Vary 에 가장 흔히 오는 Accept-Encoding 으로 나눔 */
+    if ((vary_known = cache_vary(req->uri, fields, sizeof(fields))) != 0) {
+        if (vary_known < 0)
+            strcpy(fields, "accept-encoding,");
+        if (vary_key(fields, req->hdrs, req->hdrs_len, vkey, sizeof(vkey)) == 0)
+            snprintf(key + n, sizeof(key) - n, " vary=%s", vkey);
+        else
+            snprintf(key + n, sizeof(key) - n, " vary=%p", (void *)req);  /* 모으지 않음 */
+    }
+    /* 서버에 조건부 요청을 그대로 보내거나 (304 가 올 수 있음) 자격 증명을
+     * 보내는 요청은 남에게 나눠 줄 응답을 받지 않으므로 모으지 않음 */
+    if (req->solo || req->auth || req->cookie ||
+        (!strip && (req->if_none_match[0] || req->if_modified_since[0] || req->if_range[0])))
+        snprintf(key + strlen(key), sizeof(key) - strlen(key), " solo=%p", (void *)req);
+    if ((f = flight_join(key, &follow)) == NULL) {
+        if (bg) {
+            flight_leave(&follow);
+            return;
+        }
+        if (serve_follower(req, &follow) < 0) {
+            /* 리더의 응답을 나눠 받을 수 없음: 모으지 않고 직접 가져옴 */
+            req->solo = 1;
+            serve_miss(req);
+            return;
+        }
+        lane_record(0, limit_now() - req->start);
+        return;
+    }
+    /* doit 에서 캐시를 본 뒤 (미스 큐에서 기다리는 사이) 앞선 리더가 채웠거나
+     * 재검증했을 수 있음 */
+    if ((hit = cache_peek(req->uri, req->hdrs, req->hdrs_len)) != NULL) {
+        if (cache_fresh(hit)) {
+            flight_cancel(f);
+            if (!bg) {
+                serve_hit(req, hit);
+                lane_record(0, limit_now() - req->start);
+            }
+            cache_release(hit);
+            return;
+        }
+        cache_release(hit);
+    }
+
+    /* === 1단계: 목적지 서버에 연결 === */
     
-    /* 포트 번호를 정수에서 문자열로 변환 (Open_clientfd 함수 요구사항) */
-    sprintf(portstr, "%d", port);
+    /* 포트 번호를 정수에서 문자열로 변환 (open_clientfd 함수 요구사항) */
+    sprintf(portstr, "%d", req->port);
     
-    /* 목적지 서버에 소켓 연결 생성 */
-    serverfd = Open_clientfd(hostname, portstr);
+    /* 동시 서버 작업 수 한도 확인 (-A)
+     * - 한도가 차 있으면 잠깐 기다리고, 그래도 안 되면 503 으로 거절
+     * - 코루틴 안에서는 스케줄러 스레드를 막지 않도록 기다리지 않음
+     */
+    if (!limit_acquire(io_wait_hook == NULL)) {
+        if (!bg)
+            admit_send_busy(req->clientfd);
+        flight_finish(f);
+        return;
+    }
+    start = limit_now();
+
+    /* 목적지 서버에 소켓 연결 생성
+     * (Open_clientfd 는 실패하면 프로세스를 끝내므로 오류를 돌려주는 쪽을 씀.
+     *  서버가 죽어 있으면 만료 사본을 대신 보내거나 그냥 돌아가야 함).
+     * 만료 사본을 대신 보낼 수 있으면 응답 없는 서버에 연결하느라 커널의
+     * SYN 재시도 (약 2분) 를 다 기다리지 않음 */
+    fallback = stale && !bg && cache_error_ok(stale);
+    serverfd = open_clientfd_timeout(req->hostname, portstr, fallback ? ORIGIN_TIMEOUT : 0);
     if (serverfd < 0) {
         printf("Failed to connect to end server\n");
+        limit_release();
+        /* 호스트 이름을 찾지 못함: 기억해 두고 만료 사본이 없으면 502 (-N) */
+        if (serverfd == -2)
+            neg_insert_host(req->hostname);
+        if (!serve_stale(req, f) && serverfd == -2 &&
+            (n = neg_lookup(req->uri, req->hostname, buf, sizeof(buf))) > 0)
+            send_part(req, f, buf, n);
+        flight_finish(f);
         return;  // 연결 실패 시 함수 종료
     }
 
+    /* 만료 사본을 대신 보낼 수 있으면 서버 응답을 무한정 기다리지 않음
+     * (코루틴의 논블로킹 소켓에는 적용되지 않음) */
+    if (fallback) {
+        struct timeval tv = { ORIGIN_TIMEOUT, 0 };
+        setsockopt(serverfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    }
+
     /* 서버 소켓에 대한 RIO 버퍼 초기화 */
     Rio_readinitb(&rio_server, serverfd);
 
-    /* === 4단계: HTTP 요청을 서버에 전달 === */
+    /* === 2단계: HTTP 요청을 서버에 전달 === */
     
     /* HTTP 요청 라인 생성 및 전송
      * 클라이언트의 HTTP/1.1 요청을 HTTP/1.0으로 변환
      * 예: "GET /path HTTP/1.0\r\n"
      */
-    sprintf(buf, "GET %s HTTP/1.0\r\n", path);
-    Rio_writen(serverfd, buf, strlen(buf));
+    sprintf(buf, "GET %s HTTP/1.0\r\n", req->path);
+    failed = rio_writen(serverfd, buf, strlen(buf)) < 0;
 
-    /* 클라이언트가 보낸 헤더들을 서버로 중계 */
-    while (Rio_readlineb(&rio_client, buf, MAXLINE) > 0) {
-        /* 빈 줄이 나오면 헤더 끝 (HTTP 프로토콜 규칙) */
-        if (strcmp(buf, "\r\n") == 0)
-            break;
-            
-        /* 특정 헤더들은 프록시에서 직접 처리하므로 제외
-         * - Connection: 연결 관리 (프록시가 직접 설정)
-         * - Proxy-Connection: 프록시 연결 관리
-         * - User-Agent: 브라우저 정보 (프록시가 직접 설정)
-         */
-        if (strncasecmp(buf, "Connection:", 11) != 0 &&
-            strncasecmp(buf, "Proxy-Connection:", 17) != 0 &&
-            strncasecmp(buf, "User-Agent:", 11) != 0) {
-            Rio_writen(serverfd, buf, strlen(buf));
-        }
+    /* doit 이 모아 둔 클라이언트 헤더들을 서버로 중계
+     * (재검증할 때는 클라이언트의 조건부 헤더 대신 캐시의 검증자를 보냄) */
+    failed |= forward_hdrs(serverfd, req, strip) < 0;
+    if (stale && stale->etag) {
+        snprintf(buf, MAXLINE, "If-None-Match: %s\r\n", stale->etag);
+        failed |= rio_writen(serverfd, buf, strlen(buf)) < 0;
+    }
+    if (stale && stale->last_modified) {
+        snprintf(buf, MAXLINE, "If-Modified-Since: %s\r\n", stale->last_modified);
+        failed |= rio_writen(serverfd, buf, strlen(buf)) < 0;
     }
 
-    /* 프록시에서 설정하는 필수 헤더들 추가 */
-    
-    /* User-Agent: 브라우저 식별 정보 */
-    sprintf(buf, "User-Agent: %s", user_agent_hdr);
-    Rio_writen(serverfd, buf, strlen(buf));
-    
-    /* Connection: close - 응답 후 연결 종료 */
-    sprintf(buf, "Connection: close\r\n");
-    Rio_writen(serverfd, buf, strlen(buf));
-    
-    /* Proxy-Connection: close - 프록시 연결 종료 */
-    sprintf(buf, "Proxy-Connection: close\r\n\r\n");
-    Rio_writen(serverfd, buf, strlen(buf));
+    /* 프록시에서 설정하는 필수 헤더들 추가 (User-Agent, Connection, Proxy-Connection) */
+    n = request_tail(buf);
+    failed |= rio_writen(serverfd, buf, n) < 0;
+
+    /* 서버가 연결을 끊었으면 (RST, EPIPE) 연결 실패와 같이 처리
+     * (Rio_writen 은 프로세스를 끝내므로 소문자 rio 함수로 씀) */
+    if (failed) {
+        printf("Failed to send request to end server\n");
+        Close(serverfd);
+        limit_release();
+        serve_stale(req, f);
+        flight_finish(f);
+        return;
+    }
 
-    /* === 5단계: 서버 응답을 클라이언트에 중계 === */
+    /* === 3단계: 서버 응답을 클라이언트에 중계 === */
     
     /* 서버로부터 응답을 읽어서 클라이언트에게 그대로 전달
-     * HTTP 헤더와 본문(HTML, 이미지 등) 모두 포함
+     * - 헤더는 줄 단위로 읽으며 상태 코드, Content-length, 신선도를 확인
+     * - 본문은 도착하는 만큼씩 바로 보냄 (줄이나 버퍼가 찰 때까지 기다리지 않음)
+     * 각 조각은 클라이언트에 먼저 보내고 나서 flight 버퍼(캐시 사본)에
+     * 붙이므로 캐시가 있어도 첫 바이트가 늦어지지 않는다.
+     * 재검증에 대한 304 는 클라이언트에 보내지 않는다 (아래에서 캐시 본문을 보냄).
+     * 서버 소켓은 시간 초과나 연결 끊김이 프로세스를 끝내지 않도록 소문자
+     * rio 함수로 읽는다 (-1 이면 실패).
      */
-    while (1) {
-        ssize_t n = Rio_readlineb(&rio_server, buf, MAXLINE);
-        if (n <= 0)  // 더 이상 읽을 데이터가 없으면 종료
+    fresh_init(&fr);
+    slice_begin(&sl, req->uri);
+    while ((n = rio_readlineb(&rio_server, buf, MAXLINE)) > 0) {
+        if (start) {  // 첫 응답 줄: 연결부터 여기까지가 서버 지연, 상태 코드 확인
+            limit_sample(limit_now() - start);
+            start = 0;
+            sscanf(buf, "%*s %d", &status);
+            not_modified = stale && status == 304;
+            if (status >= 500 && stale && !bg && cache_error_ok(stale))
+                break;                      // 5xx 는 보내지 않고 만료 사본으로 대신함
+        } else {
+            if (!strncasecmp(buf, "Content-length:", 15))
+                clen = atol(buf + 15);
+            else if (!strncasecmp(buf, "Content-Range:", 14) && strchr(buf, '/'))
+                rtotal = atol(strchr(buf, '/') + 1);
+            else
+                fresh_header(&fr, buf);
+            slice_header(&sl, buf, n);
+        }
+        if (!not_modified) {
+            if (!bg)
+                send_client(req, buf, n);       // 클라이언트에게 전송
+            total += n;
+            flight_append(f, buf, n);           // 따라 받는 요청들과 캐시 사본에도
+        }
+        if (!strcmp(buf, "\r\n")) {         // 헤더 끝
+            hdrs_done = 1;
             break;
-        Rio_writen(clientfd, buf, n);  // 클라이언트에게 전송
+        }
+    }
+    /* 따라 받는 요청들에게는 캐시할 수 있는 정상 응답 (200, 206, 재검증된
+     * 캐시 사본) 만 나눠 줌. 헤더를 읽다 실패했으면 받은 조각도 나눠 주지 않음 */
+    if (hdrs_done || total > 0)
+        flight_share(f, hdrs_done && (not_modified ||
+                                      ((status == 200 || status == 206) && fresh_storable(&fr, req->auth, req->cookie))));
+    /* 클라이언트에 아무것도 보내기 전에 실패했으면 (시간 초과, 5xx) 만료 사본 */
+    if (!hdrs_done && total == 0)
+        serve_stale(req, f);
+    in_body = hdrs_done && !not_modified;
+    /* -O 보다 큰 응답: 헤더 객체를 넣고 200 이면 본문을 조각으로 나눠 넣음 */
+    if (in_body && fresh_storable(&fr, req->auth, req->cookie) && fresh_meta(&fr, req, vkey, &meta) == 0) {
+        slice_start(&sl, status, status == 206 ? rtotal : clen, &meta);
+    }
+    if (not_modified && hdrs_done) {
+        /* 캐시된 사본이 여전히 유효: 신선 기간을 늘리고 캐시 본문을 보냄
+         * (클라이언트의 조건부 요청도 맞으면 본문 없이 304) */
+        cache_refresh(stale, time(NULL) + fresh_lifetime(&fr));
+        if (!bg && fresh_match(req->if_none_match, req->if_modified_since,
+                               stale->etag, stale->last_modified))
+            send_not_modified(req, stale);
+        else if (!bg)
+            send_cached(req, stale);
+        flight_append(f, stale->data, stale->size);
     }
+    while (in_body && (n = rio_readsomeb(&rio_server, buf, MAXLINE)) > 0) {
+        if (!bg)
+            send_client(req, buf, n);
+        total += n;
+        body += n;
+        flight_append(f, buf, n);
+        slice_feed(&sl, buf, n);
+    }
+    slice_end(&sl);
     
     /* 서버와의 연결 종료 */
     Close(serverfd);
+    limit_release();
+
+    /* 정상 응답(200)을 끝까지 받았으면 캐시에 저장. 본문이 Content-length 보다
+     * 짧거나 (서버가 중간에 끊음) 읽다가 실패했으면 (n < 0) 잘린 사본은 넣지
+     * 않는다. no-store, private 응답과 Authorization, Cookie 요청의 공개되지
+     * 않은 응답도 넣지 않는다.
+     * flight 를 끝내기 전에 넣어야 뒤에 온 요청이 둘 중 하나는 찾음 */
+    if (status == 200 && in_body && n == 0 && (clen < 0 || body == clen) && fresh_storable(&fr, req->auth, req->cookie) &&
+        fresh_meta(&fr, req, vkey, &meta) == 0 && (obj = flight_data(f, &objlen)) != NULL) {
+        cache_insert(req->uri, obj, objlen, &meta);
+    }
+    /* 404, 410 을 끝까지 받았으면 -N 동안 기억 (큰 응답은 상태만).
+     * Vary 가 있으면 요청마다 다를 수 있으므로 기억하지 않음 */
+    if ((status == 404 || status == 410) && in_body && n == 0 && (clen < 0 || body == clen) &&
+        fresh_storable(&fr, req->auth, req->cookie) && fr.vary[0] == '\0') {
+        obj = flight_data(f, &objlen);
+        neg_insert(req->uri, status, obj, objlen);
+    }
+    flight_finish(f);
+    if (bg)
+        return;
+
+    /* 구간만 받았으면 전체를 백그라운드로 받아 둠 (캐시에 들어갈 크기일 때만) */
+    if (status == 206 && rtotal > 0 && (size_t)rtotal <= cache_max_object())
+        refresh_submit(req, NULL);
+    cache_count_miss(total);
+    lane_record(0, limit_now() - req->start);
+}
+
+/*
+ * forward_hdrs - doit 이 모아 둔 클라이언트 헤더들을 서버로 중계
+ * (strip 이면 클라이언트의 조건부 요청과 Range 는 빼고 보냄)
+ * 반환값: 0, 서버에 쓰다 실패하면 -1
+ */
+static int forward_hdrs(int serverfd, request_t *req, int strip) {
+    const char *p, *eol, *end = req->hdrs + req->hdrs_len;
+
+    if (!strip)
+        return rio_writen(serverfd, req->hdrs, req->hdrs_len) < 0 ? -1 : 0;
+    for (p = req->hdrs; p < end; p = eol) {
+        if ((eol = memchr(p, '\n', end - p)) != NULL)
+            eol++;
+        else
+            eol = end;
+        if (!is_conditional_hdr(p) && rio_writen(serverfd, (void *)p, eol - p) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+/*
+ * fresh_meta - 응답 헤더의 신선도와 검증자, 변형 키로 cache_insert 에 넘길 값을 채움
+ *
+ * 응답에 Vary 가 있으면 req 의 헤더로 변형 키를 vkey (VARY_MAX 바이트) 에 만든다.
+ * 반환값: 0, 변형 키가 너무 길어 캐시할 수 없으면 -1
+ */
+static int fresh_meta(fresh_t *fr, request_t *req, char *vkey, cmeta_t *meta) {
+    meta->expires = time(NULL) + fresh_lifetime(fr);
+    meta->swr = fresh_swr(fr);
+    meta->sie = fresh_sie(fr);
+    meta->etag = fr->etag[0] ? fr->etag : NULL;
+    meta->last_modified = fr->last_modified_str[0] ? fr->last_modified_str : NULL;
+    meta->vary = fr->vary[0] ? fr->vary : NULL;
+    meta->vkey = meta->vary ? vkey : NULL;
+    return meta->vary ? vary_key(fr->vary, req->hdrs, req->hdrs_len, vkey, VARY_MAX) : 0;
+}
+
+/*
+ * serve_follower - 리더가 가져오는 응답을 받는 대로 클라이언트에 보냄
+ *
+ * 리더가 아무것도 받지 못하고 끝났으면 (연결 실패, 동시성 한도) 503 을 보낸다.
+ * 반환값: 0, 리더가 나눠 줄 수 없는 응답을 받았으면 (아무것도 보내지 않고) -1
+ */
+static int serve_follower(request_t *req, freader_t *follow) {
+    char buf[MAXBUF];
+    ssize_t n;
+    int unshared;
+
+    while (!req->client_gone && (n = flight_read(follow, buf, sizeof(buf))) > 0)
+        send_client(req, buf, n);
+    unshared = follow->off == 0 && flight_unshared(follow);
+    if (follow->off == 0 && !unshared)
+        admit_send_busy(req->clientfd);
+    flight_leave(follow);
+    return unshared ? -1 : 0;
+}
+
+/*
+ * read_req_hdrs - 요청 라인 다음의 헤더들을 빈 줄까지 모두 읽음
+ *
+ * 서버로 그대로 전달할 헤더는 req->hdrs 에 모으고 (넘치는 줄은 버림),
+ * 조건부 요청과 Range 는 캐시가 직접 답할 수 있도록 따로 보관한다.
+ */
+static void read_req_hdrs(request_t *req) {
+    char buf[MAXLINE];
+    ssize_t n;
+
+    req->hdrs_len = 0;
+    while ((n = rio_readlineb(&req->rio, buf, MAXLINE)) > 0 && strcmp(buf, "\r\n")) {
+        read_cond_hdr(req, buf);
+        if (is_forwarded_hdr(buf) && req->hdrs_len + n <= sizeof(req->hdrs)) {
+            memcpy(req->hdrs + req->hdrs_len, buf, n);
+            req->hdrs_len += n;
+        }
+    }
+}
+
+/*
+ * is_forwarded_hdr - 클라이언트 헤더 한 줄을 서버로 그대로 전달할지 판단
+ * 
+ * 특정 헤더들은 프록시에서 직접 처리하므로 제외
+ * - Connection: 연결 관리 (프록시가 직접 설정)
+ * - Proxy-Connection: 프록시 연결 관리
+ * - User-Agent: 브라우저 정보 (프록시가 직접 설정)
+ */
+int is_forwarded_hdr(const char *line) {
+    return strncasecmp(line, "Connection:", 11) != 0 &&
+           strncasecmp(line, "Proxy-Connection:", 17) != 0 &&
+           strncasecmp(line, "User-Agent:", 11) != 0;
+}
+
+/*
+ * is_conditional_hdr - 클라이언트의 조건부 요청이나 Range 헤더인지 판단
+ * (캐시가 재검증할 때는 이 헤더들 대신 캐시 객체의 검증자를 보내고 전체를
+ *  받음. 클라이언트에게는 캐시가 직접 304 나 206 으로 답함)
+ */
+static int is_conditional_hdr(const char *line) {
+    return !strncasecmp(line, "If-None-Match:", 14) ||
+           !strncasecmp(line, "If-Modified-Since:", 18) ||
+           !strncasecmp(line, "If-Range:", 9) ||
+           !strncasecmp(line, "Range:", 6);
+}
+
+/* cond_value - 앞 공백과 줄바꿈을 뗀 헤더 값을 REQUEST_COND_MAX 안에서 복사 */
+static void cond_value(char *out, const char *v) {
+    size_t n;
+
+    while (*v == ' ' || *v == '\t')
+        v++;
+    n = strcspn(v, "\r\n");
+    if (n >= REQUEST_COND_MAX)
+        n = REQUEST_COND_MAX - 1;
+    memcpy(out, v, n);
+    out[n] = '\0';
+}
+
+/*
+ * read_cond_hdr - 클라이언트 헤더 한 줄이 조건부 요청이나 Range 면 그 값을 요청에 보관
+ * (캐시가 직접 304 나 206 으로 답할 수 있는지 볼 때 씀)
+ */
+static void read_cond_hdr(request_t *req, const char *line) {
+    if (!strncasecmp(line, "If-None-Match:", 14))
+        cond_value(req->if_none_match, line + 14);
+    else if (!strncasecmp(line, "If-Modified-Since:", 18))
+        cond_value(req->if_modified_since, line + 18);
+    else if (!strncasecmp(line, "If-Range:", 9))
+        cond_value(req->if_range, line + 9);
+    else if (!strncasecmp(line, "Range:", 6))
+        cond_value(req->range, line + 6);
+    else if (!strncasecmp(line, "Authorization:", 14))
+        req->auth = 1;
+    else if (!strncasecmp(line, "Cookie:", 7))
+        req->cookie = 1;
+}
+
+/*
+ * request_tail - 서버로 보내는 요청 끝에 붙는 고정 헤더들과 빈 줄을 buf에 기록
+ * 
+ * 반환값: 기록한 바이트 수 (최대 REQUEST_TAIL_MAX)
+ */
+int request_tail(char *buf) {
+    return sprintf(buf, "%s"                             /* User-Agent: 브라우저 식별 정보 */
+                        "Connection: close\r\n"          /* 응답 후 연결 종료 */
+                        "Proxy-Connection: close\r\n\r\n", /* 프록시 연결 종료 */
+                   user_agent_hdr);
+}
+
+/*
+ * build_request - 클라이언트 요청 헤더 블록 전체를 서버로 보낼 요청 하나로 변환
+ * 
+ * 매개변수:
+ * - out: 결과를 담을 버퍼 (strlen(path) + strlen(hdrs) + REQUEST_TAIL_MAX + 32 바이트 이상)
+ * - path: 요청 라인에 쓸 경로
+ * - hdrs: 요청 라인 다음부터 시작하는 헤더들 ("\r\n" 으로 구분, 빈 줄 포함 가능)
+ * 
+ * 이벤트 구동 엔진처럼 요청을 한 번에 버퍼링해서 보내는 경로에서 사용한다.
+ * 반환값: out에 기록한 바이트 수
+ */
+size_t build_request(char *out, const char *path, const char *hdrs) {
+    char *p = out;
+    const char *line = hdrs, *eol;
+
+    p += sprintf(p, "GET %s HTTP/1.0\r\n", path);
+    while (*line && (eol = strstr(line, "\r\n")) != NULL && eol != line) {
+        size_t len = eol - line + 2;
+        if (is_forwarded_hdr(line)) {
+            memcpy(p, line, len);
+            p += len;
+        }
+        line += len;
+    }
+    p += request_tail(p);
+    return p - out;
+}
+
+/*
+ * parse_request_line - 헤더 블록 buf 의 첫 줄을 method, uri, version 으로 분리
+ *
+ * 세 버퍼는 MAXLINE 바이트. 요청 라인이 MAXLINE 이상이면 토큰 하나가 그만큼
+ * 길 수 있으므로 (parse_uri 의 hostname, path 도 마찬가지) 파싱하지 않고
+ * 거절한다. doit 은 MAXLINE 버퍼로 한 줄씩 읽지만 epoll/io_uring 엔진은
+ * 헤더 블록 전체를 모아 넘기므로 여기서 막는다.
+ * 반환값: 성공 0, 줄이 너무 길거나 토큰이 셋이 아니면 -1
+ */
+int parse_request_line(const char *buf, char *method, char *uri, char *version) {
+    const char *eol = strstr(buf, "\r\n");
+
+    if (!eol || eol - buf >= MAXLINE)
+        return -1;
+    if (sscanf(buf, "%8191s %8191s %8191s", method, uri, version) != 3)
+        return -1;
+    return 0;
 }
 
 /*
@@ -0,0 +1,53 @@
+/*
+ * proxy.h - 프록시의 여러 I/O 엔진이 함께 쓰는 선언
+ *
+ * proxy.c 의 요청 파싱/변환 함수를 이벤트 구동 엔진 등 다른 모듈에서도
+ * 그대로 사용할 수 있도록 모아 둔다.
+ */
+#ifndef __PROXY_H__
+#define __PROXY_H__
+
+#include "csapp.h"
+#include "topo.h"
+
+/* request_tail 이 기록하는 최대 바이트 수 */
+#define REQUEST_TAIL_MAX 256
+
+/* 클라이언트 조건부 요청 헤더 값의 최대 길이 */
+#define REQUEST_COND_MAX 256
+
+/* 요청 라인과 헤더를 읽고 파싱한 요청 (미스 차선으로 넘길 때 통째로 넘어감) */
+typedef struct {
+    int clientfd;
+    rio_t rio;                  /* 클라이언트 버퍼 */
+    char uri[MAXLINE];          /* 캐시 키 */
+    char hostname[MAXLINE];
+    char path[MAXLINE];
+    int port;
+    long start;                 /* 요청 라인을 읽은 시각 (지연 측정) */
+    struct cobj *stale;         /* 재검증할 만료된 캐시 객체 (참조를 가짐, 없으면 NULL) */
+    int head;                   /* HEAD 요청: 응답 헤더만 보냄 */
+    int hdr_end;                /* HEAD: 보낸 응답에서 "\r\n\r\n" 중 맞춘 글자 수 (4 면 헤더 끝) */
+    char if_none_match[REQUEST_COND_MAX];       /* 클라이언트 조건부 요청 (없으면 "") */
+    char if_modified_since[REQUEST_COND_MAX];
+    char range[REQUEST_COND_MAX];               /* 클라이언트 Range, If-Range (없으면 "") */
+    char if_range[REQUEST_COND_MAX];
+    int auth;                   /* Authorization 을 보냄 */
+    int cookie;                 /* Cookie 를 보냄 */
+    int solo;                   /* 다른 요청과 모으지 않고 직접 가져옴 (flight.c) */
+    int client_gone;            /* 클라이언트에 쓰다 실패함 (더 보내지 않음) */
+    char hdrs[MAXBUF];          /* 서버로 전달할 클라이언트 헤더들 (프록시가 정하는 것과 빈 줄 제외) */
+    size_t hdrs_len;
+} request_t;
+
+/* 요청 처리 (proxy.c) */
+void doit(int clientfd);
+void serve_miss(request_t *req);
+void request_free(request_t *req);
+int parse_request_line(const char *buf, char *method, char *uri, char *version);
+void parse_uri(char *uri, char *hostname, char *path, int *port);
+int is_forwarded_hdr(const char *line);
+int request_tail(char *buf);
+size_t build_request(char *out, const char *path, const char *hdrs);
+
+#endif /* __PROXY_H__ */
@@ -0,0 +1,64 @@
+/*
+ * range.c - HTTP Range 요청 헤더 해석 (캐시된 본문을 잘라 206 으로 보낼 때)
+ *
+ * bytes 단위만 받는다. 구간 하나는 "a-b" (a 부터 b 까지), "a-" (a 부터
+ * 끝까지), "-n" (마지막 n 바이트) 이다. 본문 밖에서 시작하는 구간은 빼고,
+ * 끝이 본문을 넘으면 본문 끝으로 줄인다. 형식이 틀린 값이나 구간이 너무
+ * 많은 값은 서버가 Range 를 무시해도 되므로 (RFC 9110) 전체 응답으로 답한다.
+ */
+#include "csapp.h"
+#include "range.h"
+
+/* parse_num - 10진 숫자열을 읽어 *v 에 (숫자가 없으면 0) */
+static int parse_num(const char **p, size_t *v) {
+    const char *s = *p;
+
+    *v = 0;
+    while (isdigit((unsigned char)**p))
+        *v = *v * 10 + (*(*p)++ - '0');
+    return *p != s;
+}
+
+int range_parse(const char *spec, size_t len, range_t *out) {
+    const char *p = spec;
+    size_t a, b;
+    int has_a, has_b, n = 0, nspecs = 0;
+
+    while (*p == ' ')
+        p++;
+    if (strncasecmp(p, "bytes=", 6))
+        return -1;
+    p += 6;
+    while (*p) {
+        while (*p == ' ' || *p == '\t')
+            p++;
+        has_a = parse_num(&p, &a);
+        if (*p++ != '-')
+            return -1;
+        has_b = parse_num(&p, &b);
+        while (*p == ' ' || *p == '\t')
+            p++;
+        if (*p == ',')
+            p++;
+        else if (*p)
+            return -1;
+        if ((!has_a && !has_b) || (has_a && has_b && b < a) || ++nspecs > RANGE_MAX)
+            return -1;
+
+        if (!has_a) {                   /* 마지막 b 바이트 */
+            if (b == 0 || len == 0)
+                continue;
+            a = b < len ? len - b : 0;
+            b = len - 1;
+        } else {
+            if (a >= len)
+                continue;
+            if (!has_b || b >= len)
+                b = len - 1;
+        }
+        out[n].first = a;
+        out[n].last = b;
+        n++;
+    }
+    return n;
+}
@@ -0,0 +1,21 @@
+/*
+ * range.h - HTTP Range 요청 헤더 해석 (캐시된 본문을 잘라 206 으로 보낼 때)
+ */
+#ifndef __RANGE_H__
+#define __RANGE_H__
+
+#include <stddef.h>
+
+#define RANGE_MAX 16                /* 한 요청에서 받아들이는 구간 수 */
+
+/* 본문의 [first, last] 바이트 (양 끝 포함) */
+typedef struct {
+    size_t first, last;
+} range_t;
+
+/* Range 값 ("bytes=0-99, 200-, -50") 을 길이 len 인 본문에 맞춰 out 에 풂.
+ * 반환값: 만족하는 구간 수, 만족하는 구간이 없으면 0 (416),
+ *         형식이 틀렸거나 RANGE_MAX 개를 넘으면 -1 (Range 를 무시하고 전체를 보냄) */
+int range_parse(const char *spec, size_t len, range_t *out);
+
+#endif /* __RANGE_H__ */
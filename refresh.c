@@ -0,0 +1,119 @@
+/*
+ * refresh.c - 재검증 유예 기간의 만료 객체를 백그라운드에서 재검증
+ *
+ * 서버가 stale-while-revalidate 를 줬거나 -V 를 줬으면, 만료된 캐시 객체도
+ * 유예 기간 안에는 doit 이 그대로 적중으로 보내고 여기에 재검증을 맡긴다.
+ * 요청은 서버를 기다리지 않는다.
+ *
+ * - 객체마다 재검증은 하나만 건다: refreshing 을 0 -> 1 로 바꾼 요청만
+ *   큐에 넣고, 나머지는 만료 사본을 보내기만 한다.
+ * - 워커는 클라이언트가 없는 요청(clientfd = -1)으로 serve_miss 를 부른다.
+ *   304 면 객체의 expires 만 늘고, 200 이면 새 응답이 캐시에서 옛 객체와
+ *   원자적으로 바뀌어 들어간다 (cache_insert). 같은 URI 를 이미 가져오는
+ *   요청이 있으면 그쪽에 맡긴다 (flight.c).
+ * - 재검증이 끝나면 (실패했어도) refreshing 을 풀어서, 아직 만료 상태면
+ *   다음 요청이 다시 건다.
+ * - 큐가 가득 차면 이번에는 걸지 않는다 (만료 사본은 그래도 보냄).
+ *
+ * 같은 워커가 캐시에 아직 없는 객체를 미리 받는 일도 한다 (obj 가 NULL).
+ * 서버가 Range 요청에 구간만 돌려줬을 때 전체를 받아 두면 다음 Range
+ * 요청부터는 캐시에서 잘라 답한다. 동시에 같은 URI 를 받는 중이면 flight
+ * 가 하나로 모으고, 워커가 꺼냈을 때 이미 캐시에 있으면 바로 끝난다.
+ */
+#include "refresh.h"
+
+/* 재검증 큐: 요청 포인터의 원형 배열 */
+static request_t **queue;
+static int depth, front, count;
+static pthread_mutex_t qlock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t qitems = PTHREAD_COND_INITIALIZER;
+
+static unsigned long nqueued, ndone, ndropped;
+
+/*
+ * refresh_worker - 큐에서 재검증 요청을 꺼내 서버에 보내는 일을 반복
+ */
+static void *refresh_worker(void *vargp) {
+    request_t *req;
+
+    Pthread_detach(pthread_self());
+    while (1) {
+        pthread_mutex_lock(&qlock);
+        while (count == 0)
+            pthread_cond_wait(&qitems, &qlock);
+        req = queue[front];
+        front = (front + 1) % depth;
+        count--;
+        pthread_mutex_unlock(&qlock);
+
+        serve_miss(req);
+        if (req->stale)
+            __atomic_store_n(&req->stale->refreshing, 0, __ATOMIC_RELEASE);
+        request_free(req);
+        __atomic_add_fetch(&ndone, 1, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+void refresh_init(int nworkers, int qdepth) {
+    pthread_t tid;
+    int i;
+
+    depth = qdepth;
+    queue = Calloc(depth, sizeof(request_t *));
+    for (i = 0; i < nworkers; i++)
+        Pthread_create(&tid, NULL, refresh_worker, NULL);
+}
+
+void refresh_submit(const request_t *req, cobj_t *obj) {
+    request_t *bg;
+    int idle = 0;
+
+    if (obj && !__atomic_compare_exchange_n(&obj->refreshing, &idle, 1, 0,
+                                            __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+        return;
+
+    /* 클라이언트 없는 요청: 요청 라인과 서버로 보낼 헤더만 복사
+     * (조건부 요청과 Range 는 serve_miss 가 빼고 보냄) */
+    bg = Malloc(sizeof(request_t));
+    bg->clientfd = -1;
+    strcpy(bg->uri, req->uri);
+    strcpy(bg->hostname, req->hostname);
+    strcpy(bg->path, req->path);
+    bg->port = req->port;
+    bg->start = req->start;
+    bg->stale = obj;
+    memcpy(bg->hdrs, req->hdrs, req->hdrs_len);
+    bg->hdrs_len = req->hdrs_len;
+    bg->head = bg->hdr_end = 0;
+    bg->if_none_match[0] = bg->if_modified_since[0] = '\0';
+    bg->range[0] = bg->if_range[0] = '\0';
+    bg->auth = req->auth;
+    bg->cookie = req->cookie;
+    bg->solo = bg->client_gone = 0;
+    if (obj)
+        cache_hold(obj);
+
+    pthread_mutex_lock(&qlock);
+    if (count == depth) {
+        pthread_mutex_unlock(&qlock);
+        if (obj)
+            __atomic_store_n(&obj->refreshing, 0, __ATOMIC_RELEASE);
+        request_free(bg);
+        __atomic_add_fetch(&ndropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    queue[(front + count) % depth] = bg;
+    count++;
+    pthread_cond_signal(&qitems);
+    pthread_mutex_unlock(&qlock);
+    __atomic_add_fetch(&nqueued, 1, __ATOMIC_RELAXED);
+}
+
+void refresh_stats(FILE *fp) {
+    fprintf(fp, "refresh: queued %lu done %lu dropped %lu pending %d/%d\n",
+            __atomic_load_n(&nqueued, __ATOMIC_RELAXED),
+            __atomic_load_n(&ndone, __ATOMIC_RELAXED),
+            __atomic_load_n(&ndropped, __ATOMIC_RELAXED),
+            __atomic_load_n(&count, __ATOMIC_RELAXED), depth);
+}
@@ -0,0 +1,20 @@
+/*
+ * refresh.h - 재검증 유예 기간의 만료 객체를 백그라운드에서 재검증
+ */
+#ifndef __REFRESH_H__
+#define __REFRESH_H__
+
+#include "proxy.h"
+#include "cache.h"
+
+/* 백그라운드 재검증 워커 nworkers 개와 깊이 depth 의 큐를 만듦 */
+void refresh_init(int nworkers, int depth);
+
+/* req 의 URI 로 캐시된 만료 객체 obj 를 백그라운드에서 재검증하도록 맡김.
+ * obj 에 이미 재검증이 걸려 있으면 아무것도 하지 않음 (req, obj 는 그대로 호출한 쪽 것).
+ * obj 가 NULL 이면 캐시에 없는 객체를 미리 받아 둠 */
+void refresh_submit(const request_t *req, cobj_t *obj);
+
+void refresh_stats(FILE *fp);
+
+#endif /* __REFRESH_H__ */
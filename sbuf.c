@@ -0,0 +1,40 @@
+/*
+ * sbuf.c - 유한 크기 생산자-소비자 버퍼 구현
+ */
+#include "sbuf.h"
+
+/* sbuf_init - 최대 n개의 항목을 담는 빈 버퍼 생성 */
+void sbuf_init(sbuf_t *sp, int n) {
+    sp->buf = Calloc(n, sizeof(int));
+    sp->n = n;
+    sp->front = sp->rear = 0;       /* front == rear 이면 버퍼가 비어 있음 */
+    Sem_init(&sp->mutex, 0, 1);     /* 잠금용 이진 세마포어 */
+    Sem_init(&sp->slots, 0, n);     /* 처음에는 n개의 빈 슬롯 */
+    Sem_init(&sp->items, 0, 0);     /* 처음에는 항목 없음 */
+}
+
+/* sbuf_deinit - 버퍼 메모리 해제 */
+void sbuf_deinit(sbuf_t *sp) {
+    Free(sp->buf);
+}
+
+/* sbuf_insert - 버퍼 뒤쪽에 항목 삽입 (가득 차 있으면 빈 슬롯이 생길 때까지 대기) */
+void sbuf_insert(sbuf_t *sp, int item) {
+    P(&sp->slots);                          /* 빈 슬롯 대기 */
+    P(&sp->mutex);                          /* 버퍼 잠금 */
+    sp->buf[(++sp->rear) % (sp->n)] = item; /* 항목 삽입 */
+    V(&sp->mutex);                          /* 버퍼 잠금 해제 */
+    V(&sp->items);                          /* 새 항목 알림 */
+}
+
+/* sbuf_remove - 버퍼 앞쪽의 항목을 꺼내 반환 (비어 있으면 항목이 들어올 때까지 대기) */
+int sbuf_remove(sbuf_t *sp) {
+    int item;
+
+    P(&sp->items);                          /* 항목 대기 */
+    P(&sp->mutex);                          /* 버퍼 잠금 */
+    item = sp->buf[(++sp->front) % (sp->n)];/* 항목 꺼내기 */
+    V(&sp->mutex);                          /* 버퍼 잠금 해제 */
+    V(&sp->slots);                          /* 빈 슬롯 알림 */
+    return item;
+}
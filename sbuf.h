@@ -0,0 +1,28 @@
+/*
+ * sbuf.h - 프리스레드 프록시에서 사용하는 유한 크기 생산자-소비자 버퍼
+ *
+ * accept 루프(생산자)가 연결 소켓을 넣고, 미리 만들어 둔 워커
+ * 스레드들(소비자)이 꺼내 간다. 버퍼가 가득 차면 생산자가, 비어 있으면
+ * 소비자가 세마포어에서 대기한다. (CS:APP 12.5.4 sbuf 패키지 기반)
+ */
+#ifndef __SBUF_H__
+#define __SBUF_H__
+
+#include "csapp.h"
+
+typedef struct {
+    int *buf;       /* 연결 소켓을 저장하는 원형 배열 */
+    int n;          /* 최대 슬롯 수 (큐 깊이) */
+    int front;      /* buf[(front+1)%n] 이 첫 번째 항목 */
+    int rear;       /* buf[rear%n] 이 마지막 항목 */
+    sem_t mutex;    /* buf 접근을 보호하는 뮤텍스 */
+    sem_t slots;    /* 비어 있는 슬롯 수 */
+    sem_t items;    /* 꺼낼 수 있는 항목 수 */
+} sbuf_t;
+
+void sbuf_init(sbuf_t *sp, int n);
+void sbuf_deinit(sbuf_t *sp);
+void sbuf_insert(sbuf_t *sp, int item);
+int sbuf_remove(sbuf_t *sp);
+
+#endif /* __SBUF_H__ */
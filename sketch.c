@@ -0,0 +1,128 @@
+/*
+ * sketch.c - TinyLFU 빈도 추정기 (count-min sketch + doorkeeper)
+ *
+ * 최근에 키가 몇 번 요청됐는지를 작은 고정 메모리로 추정한다.
+ *
+ * - count-min sketch: SKETCH_DEPTH 개의 행에서 키마다 다른 위치의 카운터를
+ *   올리고, 추정치는 그중 최솟값이다 (충돌로 과대 추정만 생김).
+ *   카운터는 15 에서 멈춘다.
+ * - doorkeeper: 처음 보는 키는 카운터 대신 블룸 필터 비트만 켠다. 한 번만
+ *   요청되는 대부분의 객체가 sketch 를 더럽히지 않는다. 추정치에는
+ *   doorkeeper 에 있으면 1을 더한다.
+ * - 노화: 실제로 늘린 횟수가 sample (= 10 x width) 에 닿으면 모든
+ *   카운터를 반으로 줄이고 doorkeeper 를 비워, 오래전 인기보다 최근
+ *   인기를 반영한다.
+ *
+ * 여러 스레드가 잠금 없이 올리므로 값은 근사치다. 이미 15 인 카운터나
+ * 켜진 비트는 다시 쓰지 않으므로, 인기 있는 키일수록 공유 메모리에
+ * 쓰는 일이 줄어든다.
+ */
+#include "csapp.h"
+#include "sketch.h"
+
+#define SKETCH_DEPTH     4
+#define SKETCH_MAX_COUNT 15
+#define SKETCH_MIN_WIDTH 1024
+#define ULONG_BITS       (8 * sizeof(unsigned long))
+
+static const unsigned seeds[SKETCH_DEPTH] = {
+    0x9E3779B1u, 0x85EBCA77u, 0xC2B2AE3Du, 0x27D4EB2Fu
+};
+
+void sketch_init(sketch_t *s, unsigned items) {
+    s->width = SKETCH_MIN_WIDTH;
+    while (s->width < items && s->width < (1u << 24))
+        s->width <<= 1;
+    s->counts = Calloc((size_t)SKETCH_DEPTH * s->width, 1);
+    s->door = Calloc(2 * s->width / ULONG_BITS, sizeof(unsigned long));
+    s->adds = 0;
+    s->sample = 10UL * s->width;
+    s->resets = 0;
+}
+
+/* slot - i 번째 행에서 hash 의 카운터 위치 */
+static unsigned char *slot(sketch_t *s, unsigned hash, int i) {
+    unsigned h = (hash ^ (hash >> 15)) * seeds[i];
+
+    return &s->counts[(size_t)i * s->width + ((h ^ (h >> 13)) & (s->width - 1))];
+}
+
+/* door_pos - doorkeeper 에서 hash 의 비트 두 개 중 i 번째 위치 */
+static void door_pos(sketch_t *s, unsigned hash, int i, unsigned long **word, unsigned long *mask) {
+    unsigned h = (hash ^ (hash >> 16)) * seeds[SKETCH_DEPTH - 1 - i];
+    unsigned bit = (h >> 7) & (2 * s->width - 1);
+
+    *word = &s->door[bit / ULONG_BITS];
+    *mask = 1UL << (bit % ULONG_BITS);
+}
+
+static int door_contains(sketch_t *s, unsigned hash) {
+    unsigned long *w, m;
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        door_pos(s, hash, i, &w, &m);
+        if (!(__atomic_load_n(w, __ATOMIC_RELAXED) & m))
+            return 0;
+    }
+    return 1;
+}
+
+/*
+ * age - 모든 카운터를 반으로, doorkeeper 는 비움
+ */
+static void age(sketch_t *s) {
+    size_t i, n = (size_t)SKETCH_DEPTH * s->width;
+
+    for (i = 0; i < n; i++)
+        __atomic_store_n(&s->counts[i], __atomic_load_n(&s->counts[i], __ATOMIC_RELAXED) >> 1,
+                         __ATOMIC_RELAXED);
+    for (i = 0; i < 2 * s->width / ULONG_BITS; i++)
+        __atomic_store_n(&s->door[i], 0, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&s->resets, 1, __ATOMIC_RELAXED);
+}
+
+void sketch_add(sketch_t *s, unsigned hash) {
+    unsigned long *w, m;
+    unsigned char *c, v, min = SKETCH_MAX_COUNT;
+    int i, changed = 0;
+
+    /* 처음 보는 키: doorkeeper 에만 기록 */
+    if (!door_contains(s, hash)) {
+        for (i = 0; i < 2; i++) {
+            door_pos(s, hash, i, &w, &m);
+            if (!(__atomic_load_n(w, __ATOMIC_RELAXED) & m))
+                __atomic_or_fetch(w, m, __ATOMIC_RELAXED);
+        }
+        changed = 1;
+    } else {
+        /* 최솟값인 카운터만 올림 (conservative update: 과대 추정이 줄어듦) */
+        for (i = 0; i < SKETCH_DEPTH; i++)
+            if ((v = __atomic_load_n(slot(s, hash, i), __ATOMIC_RELAXED)) < min)
+                min = v;
+        if (min < SKETCH_MAX_COUNT) {
+            for (i = 0; i < SKETCH_DEPTH; i++) {
+                c = slot(s, hash, i);
+                if (__atomic_load_n(c, __ATOMIC_RELAXED) == min)
+                    __atomic_store_n(c, min + 1, __ATOMIC_RELAXED);
+            }
+            changed = 1;
+        }
+    }
+
+    /* sample 번째로 늘린 스레드가 노화를 맡음 */
+    if (changed && __atomic_add_fetch(&s->adds, 1, __ATOMIC_RELAXED) == s->sample) {
+        age(s);
+        __atomic_store_n(&s->adds, s->sample / 2, __ATOMIC_RELAXED);
+    }
+}
+
+int sketch_estimate(sketch_t *s, unsigned hash) {
+    unsigned char v, min = SKETCH_MAX_COUNT;
+    int i;
+
+    for (i = 0; i < SKETCH_DEPTH; i++)
+        if ((v = __atomic_load_n(slot(s, hash, i), __ATOMIC_RELAXED)) < min)
+            min = v;
+    return min + door_contains(s, hash);
+}
@@ -0,0 +1,21 @@
+/*
+ * sketch.h - TinyLFU 빈도 추정기 (count-min sketch + doorkeeper)
+ */
+#ifndef __SKETCH_H__
+#define __SKETCH_H__
+
+typedef struct {
+    unsigned char *counts;      /* SKETCH_DEPTH 행 x width 개의 카운터 (최대 15) */
+    unsigned width;             /* 행 하나의 카운터 수 (2의 거듭제곱) */
+    unsigned long *door;        /* doorkeeper 블룸 필터 (width * 2 비트) */
+    unsigned long adds;         /* 마지막 노화 이후 실제로 늘린 횟수 */
+    unsigned long sample;       /* adds 가 이만큼 되면 모든 카운터를 반으로 */
+    unsigned long resets;       /* 노화 횟수 */
+} sketch_t;
+
+/* items: 추적할 만한 객체 수 (카운터 폭과 노화 주기를 정함) */
+void sketch_init(sketch_t *s, unsigned items);
+void sketch_add(sketch_t *s, unsigned hash);
+int sketch_estimate(sketch_t *s, unsigned hash);
+
+#endif /* __SKETCH_H__ */
@@ -0,0 +1,153 @@
+/*
+ * slice.c - 캐시 객체 최대 크기를 넘는 응답을 고정 크기 조각으로 나눠 캐시
+ *
+ * -Z 로 조각 크기를 주면, cache_max_object 를 넘어 통째로는 캐시하지 못하는
+ * 응답을 다음 두 종류의 캐시 객체로 나눠 넣는다:
+ *
+ * - 헤더 객체 ("uri slices"): 상태 줄을 "200 OK" 로, Content-length 를 전체
+ *   크기로 고친 응답 헤더 블록. 신선도와 검증자도 여기에 붙는다.
+ * - 조각 객체 ("uri slice=N"): 본문의 N * 조각크기 부터 조각 크기만큼의
+ *   바이트 (마지막 조각은 짧을 수 있음). 헤더 없이 본문만 담는다.
+ *
+ * 서버가 200 으로 전체를 보내면 중계하면서 조각을 채워 넣고, 206 으로
+ * 구간만 보내면 헤더 객체만 넣는다. 그 뒤의 요청은 proxy.c 가 헤더 객체를
+ * 찾아 필요한 조각들로 응답을 조립하고, 캐시에 없는 조각만 서버에 조각
+ * 크기의 Range 로 받아 채운다. 조각마다 따로 캐시되므로 큰 연속 메모리가
+ * 필요 없고, 많이 보는 구간만 남는다.
+ *
+ * 조각은 헤더 객체와 검증자(ETag, Last-Modified)가 같을 때만 쓴다.
+ * 검증자가 없으면 헤더 객체보다 나중에 들어온 조각만 쓴다. Vary 가 있는
+ * 응답은 조각 키로 변형을 구분할 수 없으므로 나누지 않는다.
+ */
+#include "csapp.h"
+#include "slice.h"
+
+static size_t size;                 /* 조각 크기 (0 이면 끔) */
+static unsigned long nheads, nstored, nfetched, nfailed;
+
+void slice_init(size_t sz) {
+    size = sz < cache_max_object() ? sz : cache_max_object();
+}
+
+size_t slice_size(void) {
+    return size;
+}
+
+void slice_key(const char *uri, long idx, char *out) {
+    if (idx < 0)
+        sprintf(out, "%s slices", uri);
+    else
+        sprintf(out, "%s slice=%ld", uri, idx);
+}
+
+long slice_length(const cobj_t *head) {
+    const char *p = head->data, *end = head->data + head->size, *eol;
+
+    while (p < end && (eol = memchr(p, '\n', end - p)) != NULL) {
+        if (!strncasecmp(p, "Content-length:", 15))
+            return atol(p + 15);
+        p = eol + 1;
+    }
+    return -1;
+}
+
+/* same_str - 둘 다 NULL 이거나 같은 문자열인지 */
+static int same_str(const char *a, const char *b) {
+    return a == b || (a && b && !strcmp(a, b));
+}
+
+int slice_valid(const cobj_t *head, const cobj_t *s) {
+    if (head->etag || head->last_modified)
+        return same_str(head->etag, s->etag) && same_str(head->last_modified, s->last_modified);
+    return s->date >= head->date;
+}
+
+void slice_begin(slicer_t *s, const char *uri) {
+    s->uri = uri;
+    s->hdrs = size ? Malloc(MAXBUF) : NULL;
+    s->hdrs_len = 0;
+    s->buf = NULL;
+}
+
+void slice_header(slicer_t *s, const char *line, size_t n) {
+    if (!s->hdrs || !strcmp(line, "\r\n") ||
+        !strncasecmp(line, "Content-length:", 15) || !strncasecmp(line, "Content-Range:", 14))
+        return;
+    if (s->hdrs_len + n > MAXBUF - 64) {        /* 헤더가 너무 많으면 나누지 않음 */
+        Free(s->hdrs);
+        s->hdrs = NULL;
+        return;
+    }
+    memcpy(s->hdrs + s->hdrs_len, line, n);
+    s->hdrs_len += n;
+}
+
+void slice_start(slicer_t *s, int status, long total, const cmeta_t *meta) {
+    char key[strlen(s->uri) + SLICE_KEY_EXTRA];
+    size_t n;
+
+    if (!s->hdrs || (status != 200 && status != 206) || total <= (long)cache_max_object() || meta->vary)
+        return;
+    n = sprintf(s->hdrs + s->hdrs_len, "Content-length: %ld\r\n\r\n", total);
+    memmove(s->hdrs + 17, s->hdrs, s->hdrs_len + n);
+    memcpy(s->hdrs, "HTTP/1.0 200 OK\r\n", 17);
+    slice_key(s->uri, -1, key);
+    cache_insert(key, s->hdrs, s->hdrs_len + n + 17, meta);
+    __atomic_add_fetch(&nheads, 1, __ATOMIC_RELAXED);
+
+    if (status == 200) {
+        s->buf = Malloc(size);
+        s->fill = 0;
+        s->idx = 0;
+        s->total = total;
+        s->meta = *meta;
+    }
+}
+
+void slice_feed(slicer_t *s, const char *buf, size_t n) {
+    char key[s->buf ? strlen(s->uri) + SLICE_KEY_EXTRA : 1];
+    size_t want, m;
+
+    while (s->buf && n > 0) {
+        want = s->total - s->idx * size;
+        if (want > size)
+            want = size;
+        m = n < want - s->fill ? n : want - s->fill;
+        memcpy(s->buf + s->fill, buf, m);
+        s->fill += m;
+        buf += m;
+        n -= m;
+        if (s->fill < want)
+            break;
+        slice_key(s->uri, s->idx, key);
+        cache_insert(key, s->buf, s->fill, &s->meta);
+        __atomic_add_fetch(&nstored, 1, __ATOMIC_RELAXED);
+        s->fill = 0;
+        if ((size_t)++s->idx * size >= s->total) {   /* 마지막 조각까지 넣음 */
+            Free(s->buf);
+            s->buf = NULL;
+        }
+    }
+}
+
+void slice_end(slicer_t *s) {
+    if (s->hdrs)
+        Free(s->hdrs);
+    if (s->buf)                         /* 본문이 잘렸음: 채우던 조각은 버림 */
+        Free(s->buf);
+    s->hdrs = s->buf = NULL;
+}
+
+void slice_count_fetch(int ok) {
+    __atomic_add_fetch(ok ? &nfetched : &nfailed, 1, __ATOMIC_RELAXED);
+}
+
+void slice_stats(FILE *fp) {
+    if (!size)
+        return;
+    fprintf(fp, "slice: size %zu heads %lu stored %lu fetched %lu failed %lu\n", size,
+            __atomic_load_n(&nheads, __ATOMIC_RELAXED),
+            __atomic_load_n(&nstored, __ATOMIC_RELAXED),
+            __atomic_load_n(&nfetched, __ATOMIC_RELAXED),
+            __atomic_load_n(&nfailed, __ATOMIC_RELAXED));
+}
@@ -0,0 +1,58 @@
+/*
+ * slice.h - 캐시 객체 최대 크기를 넘는 응답을 고정 크기 조각으로 나눠 캐시
+ */
+#ifndef __SLICE_H__
+#define __SLICE_H__
+
+#include "cache.h"
+
+/* 조각 키를 담을 버퍼에 uri 말고 더 필요한 바이트 */
+#define SLICE_KEY_EXTRA 32
+
+/* 조각 크기 (0 이면 나누지 않음, cache_max_object 보다 크면 그만큼으로 줄임) */
+void slice_init(size_t size);
+size_t slice_size(void);
+
+/* uri 의 idx 번째 조각의 캐시 키 (idx 가 -1 이면 헤더 객체의 키) */
+void slice_key(const char *uri, long idx, char *out);
+
+/* 헤더 객체의 Content-length (전체 본문 크기, 없으면 -1) */
+long slice_length(const cobj_t *head);
+
+/* 캐시된 조각 s 가 헤더 객체 head 와 같은 응답에서 나왔는지 */
+int slice_valid(const cobj_t *head, const cobj_t *s);
+
+/* 서버 응답을 중계하면서 헤더 객체와 조각들을 만드는 상태 (serve_miss 의 스택에 둠) */
+typedef struct {
+    const char *uri;
+    char *hdrs;                 /* 헤더 객체에 넣을 헤더 줄들 (나누지 않으면 NULL) */
+    size_t hdrs_len;
+    char *buf;                  /* 지금 채우는 조각 (200 을 받을 때만) */
+    size_t fill;                /* buf 에 모인 바이트 */
+    long idx;                   /* buf 가 몇 번째 조각인지 */
+    size_t total;               /* 전체 본문 크기 */
+    cmeta_t meta;
+} slicer_t;
+
+/* 응답 헤더를 읽기 전에 부름 */
+void slice_begin(slicer_t *s, const char *uri);
+
+/* 응답의 헤더 줄 하나 (상태 줄 다음부터, 빈 줄 포함) */
+void slice_header(slicer_t *s, const char *line, size_t n);
+
+/* 헤더 끝: status 가 200 이나 206 이고 전체 크기 total 이 cache_max_object 를
+ * 넘으면 헤더 객체를 넣음. 200 이면 뒤따르는 본문을 조각으로 나눠 넣을 준비 */
+void slice_start(slicer_t *s, int status, long total, const cmeta_t *meta);
+
+/* 본문 조각 (다 찬 조각은 바로 캐시에 넣음) */
+void slice_feed(slicer_t *s, const char *buf, size_t n);
+
+/* 응답 끝: 버퍼를 놓음 (본문이 잘렸으면 채우던 조각은 버림) */
+void slice_end(slicer_t *s);
+
+/* 캐시에 없던 조각을 서버에서 Range 로 받았음 (ok 가 0 이면 실패) */
+void slice_count_fetch(int ok);
+
+void slice_stats(FILE *fp);
+
+#endif /* __SLICE_H__ */
@@ -0,0 +1,222 @@
+/*
+ * steal.c - 작업 훔치기 워커 풀 (-m steal)
+ *
+ * pool 모드는 accept 루프 하나가 공유 큐(sbuf) 하나로 모든 워커에게
+ * 연결을 넘긴다. 여기서는 그런 공유 전달 지점이 없다:
+ *
+ * - 워커마다 Chase-Lev 덱(deque.c)을 하나씩 가진다.
+ * - 자기 덱이 비면 워커가 직접 논블로킹 accept 로 연결을 최대
+ *   STEAL_ACCEPT_BATCH 개까지 받아 자기 덱에 넣는다.
+ * - 자기 덱도 비고 받을 연결도 없으면 다른 워커의 덱 위쪽에서 훔친다.
+ *
+ * 느린 서버 때문에 doit 에 묶인 워커의 덱에 쌓인 연결은 놀고 있는 워커가
+ * 가져가므로, 일부 워커만 밀리고 나머지는 노는 불균형이 생기지 않는다.
+ * 훔친 횟수와 덱 깊이는 steal_stats 로 볼 수 있다 (proxy -S).
+ */
+#include "proxy.h"
+#include "deque.h"
+#include "steal.h"
+#include "admit.h"
+#include <poll.h>
+#include <sys/eventfd.h>
+
+#define STEAL_DEQUE_SIZE    256     /* 워커별 덱 크기 */
+#define STEAL_ACCEPT_BATCH  8       /* 덱이 비었을 때 한 번에 받는 최대 연결 수 */
+#define STEAL_IDLE_MS       50      /* 할 일이 없을 때 다시 확인하는 주기 */
+
+struct pool;
+
+/* 워커 하나의 상태 (다른 워커와 캐시 라인을 공유하지 않도록 정렬) */
+typedef struct {
+    deque_t dq;
+    struct pool *pool;
+    int id;
+    int cpu;                        /* 이 워커를 고정할 CPU (-1이면 고정하지 않음) */
+    unsigned seed;                  /* 훔칠 대상 선택용 난수 상태 */
+    unsigned long handled;          /* 처리한 연결 수 */
+    unsigned long accepted;         /* 직접 받은 연결 수 */
+    unsigned long steals;           /* 다른 워커에게서 훔친 연결 수 */
+    unsigned long steal_misses;     /* 훔치기를 시도했지만 빈손이었던 횟수 */
+} __attribute__((aligned(64))) worker_t;
+
+typedef struct pool {
+    int listenfd;
+    int cpu;                        /* 샤드 CPU (-1이면 -c 목록을 따름) */
+    int nworkers;
+    worker_t *workers;
+    int wakefd;                     /* 놀고 있는 워커를 깨우는 eventfd (세마포어 모드) */
+    int nidle;                      /* 놀고 있는 워커 수 */
+    struct pool *next;              /* 통계 출력용 풀 목록 */
+} pool_t;
+
+static pool_t *pools;               /* 만든 풀 목록 (-r 이면 샤드마다 하나) */
+
+/*
+ * accept_batch - 대기 중인 연결을 자기 덱에 최대 STEAL_ACCEPT_BATCH 개까지 받음
+ *
+ * 여러 개를 받았고 놀고 있는 워커가 있으면 깨워서 훔쳐 가게 한다.
+ * 반환값: 받은 연결 수
+ */
+static int accept_batch(worker_t *w) {
+    pool_t *p = w->pool;
+    struct sockaddr_storage clientaddr;
+    socklen_t clientlen;
+    int fd, n = 0, idle;
+
+    while (n < STEAL_ACCEPT_BATCH) {
+        clientlen = sizeof(clientaddr);
+        if ((fd = accept(p->listenfd, (SA *)&clientaddr, &clientlen)) < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                fprintf(stderr, "accept error: %s\n", strerror(errno));
+            break;
+        }
+        if (!admit_accept(fd))              /* 한도 초과: 503 을 보내고 이미 닫힘 */
+            continue;
+        if (deque_push(&w->dq, fd) < 0) {   /* 덱이 가득 참: 바로 처리 */
+            admit_begin();
+            doit(fd);
+            Close(fd);
+            admit_end();
+            w->handled++;
+            break;
+        }
+        n++;
+    }
+    w->accepted += n;
+
+    idle = __atomic_load_n(&p->nidle, __ATOMIC_RELAXED);
+    if (n > 1 && idle > 0) {
+        uint64_t v = n - 1 < idle ? n - 1 : idle;
+        if (write(p->wakefd, &v, sizeof(v)) < 0)
+            fprintf(stderr, "eventfd write error: %s\n", strerror(errno));
+    }
+    return n;
+}
+
+/*
+ * try_steal - 임의의 워커부터 차례로 돌며 하나를 훔침
+ * 반환값: 연결 소켓, 훔칠 것이 없으면 DEQUE_EMPTY
+ */
+static int try_steal(worker_t *w) {
+    pool_t *p = w->pool;
+    int i, start, fd;
+
+    if (p->nworkers < 2)
+        return DEQUE_EMPTY;
+    start = rand_r(&w->seed) % p->nworkers;
+    for (i = 0; i < p->nworkers; i++) {
+        worker_t *victim = &p->workers[(start + i) % p->nworkers];
+        if (victim == w)
+            continue;
+        do {
+            fd = deque_steal(&victim->dq);
+        } while (fd == DEQUE_ABORT);
+        if (fd >= 0) {
+            w->steals++;
+            return fd;
+        }
+    }
+    w->steal_misses++;
+    return DEQUE_EMPTY;
+}
+
+/*
+ * wait_for_work - 새 연결이나 깨우기 신호가 올 때까지 (최대 STEAL_IDLE_MS) 대기
+ */
+static void wait_for_work(pool_t *p) {
+    struct pollfd fds[2];
+    uint64_t v;
+
+    fds[0].fd = p->listenfd;
+    fds[0].events = POLLIN;
+    fds[1].fd = p->wakefd;
+    fds[1].events = POLLIN;
+
+    __atomic_add_fetch(&p->nidle, 1, __ATOMIC_RELAXED);
+    if (poll(fds, 2, STEAL_IDLE_MS) > 0 && (fds[1].revents & POLLIN)) {
+        if (read(p->wakefd, &v, sizeof(v)) < 0 && errno != EAGAIN)
+            fprintf(stderr, "eventfd read error: %s\n", strerror(errno));
+    }
+    __atomic_sub_fetch(&p->nidle, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * steal_worker - 워커 스레드: 자기 덱 → 직접 accept → 훔치기 순으로 일을 찾음
+ */
+static void *steal_worker(void *vargp) {
+    worker_t *w = vargp;
+    pool_t *p = w->pool;
+    int fd;
+
+    pin_thread(w->cpu);
+    while (1) {
+        if ((fd = deque_take(&w->dq)) < 0 &&
+            (accept_batch(w) == 0 || (fd = deque_take(&w->dq)) < 0) &&
+            (fd = try_steal(w)) < 0) {
+            wait_for_work(p);
+            continue;
+        }
+        admit_begin();
+        doit(fd);
+        Close(fd);
+        admit_end();
+        w->handled++;
+    }
+    return NULL;
+}
+
+/*
+ * steal_start - listenfd 를 처리하는 nworkers 개의 워커 풀을 띄움 (바로 반환)
+ */
+void steal_start(int listenfd, int nworkers, int cpu) {
+    pool_t *p = Calloc(1, sizeof(pool_t));
+    pthread_t tid;
+    int i;
+
+    if (fcntl(listenfd, F_SETFL, fcntl(listenfd, F_GETFL, 0) | O_NONBLOCK) < 0)
+        unix_error("fcntl error");
+    if ((p->wakefd = eventfd(0, EFD_NONBLOCK | EFD_SEMAPHORE)) < 0)
+        unix_error("eventfd error");
+    p->listenfd = listenfd;
+    p->cpu = cpu;
+    p->nworkers = nworkers;
+    if (posix_memalign((void **)&p->workers, 64, nworkers * sizeof(worker_t)) != 0)
+        app_error("posix_memalign error");
+    memset(p->workers, 0, nworkers * sizeof(worker_t));
+    p->next = pools;
+    pools = p;
+
+    for (i = 0; i < nworkers; i++) {
+        worker_t *w = &p->workers[i];
+        deque_init(&w->dq, STEAL_DEQUE_SIZE);
+        w->pool = p;
+        w->id = i;
+        w->seed = i + 1;
+        w->cpu = cpu >= 0 ? cpu : topo_cpu(i);
+        topo_thread_create(&tid, steal_worker, w, w->cpu);
+        Pthread_detach(tid);
+    }
+}
+
+/*
+ * steal_stats - 워커별 덱 깊이와 처리/훔치기 횟수 출력
+ *
+ * 다른 스레드가 갱신 중인 카운터를 그대로 읽으므로 값은 근사치다.
+ */
+void steal_stats(FILE *fp) {
+    pool_t *p;
+    int i;
+
+    for (p = pools; p; p = p->next) {
+        for (i = 0; i < p->nworkers; i++) {
+            worker_t *w = &p->workers[i];
+            fprintf(fp, "steal shard %d worker %d: depth %ld handled %lu accepted %lu "
+                        "steals %lu misses %lu\n",
+                    p->cpu, w->id, deque_size(&w->dq),
+                    __atomic_load_n(&w->handled, __ATOMIC_RELAXED),
+                    __atomic_load_n(&w->accepted, __ATOMIC_RELAXED),
+                    __atomic_load_n(&w->steals, __ATOMIC_RELAXED),
+                    __atomic_load_n(&w->steal_misses, __ATOMIC_RELAXED));
+        }
+    }
+}
@@ -0,0 +1,15 @@
+/*
+ * steal.h - 작업 훔치기 워커 풀 (-m steal)
+ */
+#ifndef __STEAL_H__
+#define __STEAL_H__
+
+#include <stdio.h>
+
+/* listenfd 를 처리하는 워커 풀을 띄움 (cpu >= 0 이면 워커를 해당 CPU 에 고정) */
+void steal_start(int listenfd, int nworkers, int cpu);
+
+/* 워커별 덱 깊이와 훔치기 횟수 출력 */
+void steal_stats(FILE *fp);
+
+#endif /* __STEAL_H__ */
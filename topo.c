@@ -0,0 +1,217 @@
+/*
+ * topo.c - CPU 고정과 NUMA 노드 로컬 메모리 배치
+ *
+ * -c 로 CPU 목록을 주면 프로세스를 그 CPU 들로 제한하고, 워커/이벤트 루프
+ * 스레드를 목록의 CPU 에 하나씩 돌아가며 고정한다. 고정된 스레드는
+ * MPOL_LOCAL 정책을 써서 이후 처음 건드리는 페이지가 자기 노드에
+ * 잡히게 하고, 오래 사는 스레드의 스택(doit 의 rio_t 와 중계 버퍼가
+ * 사는 곳)과 io_uring 고정 버퍼처럼 스레드 전용인 큰 영역은 처음부터
+ * 해당 CPU 의 노드에 묶어서 할당한다.
+ *
+ * libnuma 에 의존하지 않도록 노드 정보는 /sys 에서 읽고 mbind 와
+ * set_mempolicy 는 시스템 콜로 직접 호출한다.
+ */
+#define _GNU_SOURCE
+#include "csapp.h"
+#include "topo.h"
+#include <sched.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+#define TOPO_MAX_NODES 1024
+
+static int cpu_node[CPU_SETSIZE];   /* CPU 번호 → NUMA 노드 번호 */
+static int nnodes = 1;              /* NUMA 노드 수 */
+static int cpus[CPU_SETSIZE];       /* -c 로 준 CPU 들 (순서대로) */
+static int ncpus = 0;               /* 0이면 -c 를 주지 않음 */
+
+/*
+ * read_cpu_node - /sys/devices/system/cpu/cpuN/nodeM 항목으로 CPU 의 노드를 찾음
+ */
+static int read_cpu_node(int cpu) {
+    char path[64];
+    struct dirent *de;
+    DIR *dir;
+    int node = 0;
+
+    sprintf(path, "/sys/devices/system/cpu/cpu%d", cpu);
+    if ((dir = opendir(path)) == NULL)
+        return 0;
+    while ((de = readdir(dir)) != NULL) {
+        if (!strncmp(de->d_name, "node", 4) && isdigit((unsigned char)de->d_name[4])) {
+            node = atoi(de->d_name + 4);
+            break;
+        }
+    }
+    closedir(dir);
+    return node;
+}
+
+/*
+ * parse_cpulist - "0-3,8,10-11" 형식을 CPU 집합으로 변환
+ * 반환값: 성공 0, 형식 오류 -1
+ */
+static int parse_cpulist(const char *list, cpu_set_t *set) {
+    const char *p = list;
+    char *end;
+    long lo, hi;
+
+    CPU_ZERO(set);
+    while (*p) {
+        lo = strtol(p, &end, 10);
+        if (end == p || lo < 0 || lo >= CPU_SETSIZE)
+            return -1;
+        hi = lo;
+        if (*end == '-') {
+            p = end + 1;
+            hi = strtol(p, &end, 10);
+            if (end == p || hi < lo || hi >= CPU_SETSIZE)
+                return -1;
+        }
+        for (; lo <= hi; lo++)
+            CPU_SET(lo, set);
+        if (*end == ',')
+            end++;
+        else if (*end != '\0')
+            return -1;
+        p = end;
+    }
+    return CPU_COUNT(set) > 0 ? 0 : -1;
+}
+
+/*
+ * topo_init - 노드 구성을 읽고, cpulist 가 있으면 프로세스를 그 CPU 들로 제한
+ * 반환값: 성공 0, cpulist 형식 오류나 설정 실패 시 -1
+ */
+int topo_init(const char *cpulist) {
+    cpu_set_t set;
+    int cpu;
+
+    for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        cpu_node[cpu] = 0;
+        if (cpu < sysconf(_SC_NPROCESSORS_CONF)) {
+            cpu_node[cpu] = read_cpu_node(cpu);
+            if (cpu_node[cpu] + 1 > nnodes)
+                nnodes = cpu_node[cpu] + 1;
+        }
+    }
+
+    if (!cpulist)
+        return 0;
+    if (parse_cpulist(cpulist, &set) < 0) {
+        fprintf(stderr, "invalid cpu list: %s\n", cpulist);
+        return -1;
+    }
+    if (sched_setaffinity(0, sizeof(set), &set) < 0) {
+        fprintf(stderr, "sched_setaffinity(%s): %s\n", cpulist, strerror(errno));
+        return -1;
+    }
+    sched_getaffinity(0, sizeof(set), &set);    /* 없는 CPU 는 커널이 빼 줌 */
+    for (cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        if (CPU_ISSET(cpu, &set))
+            cpus[ncpus++] = cpu;
+    return 0;
+}
+
+/*
+ * topo_cpu - i 번째 워커를 고정할 CPU (-c 목록을 돌아가며 배정, 없으면 -1)
+ */
+int topo_cpu(int i) {
+    return ncpus > 0 ? cpus[i % ncpus] : -1;
+}
+
+/* topo_node - CPU 가 속한 NUMA 노드 */
+int topo_node(int cpu) {
+    return cpu >= 0 && cpu < CPU_SETSIZE ? cpu_node[cpu] : 0;
+}
+
+/*
+ * pin_thread - 호출한 스레드를 cpu 번 CPU 에 고정 (cpu < 0 이면 아무것도 하지 않음)
+ *
+ * 고정한 뒤에는 메모리 정책을 MPOL_LOCAL 로 바꿔, 이 스레드가 처음 건드리는
+ * 페이지(스택, 자기 malloc arena 등)가 같은 노드에서 할당되게 한다.
+ */
+void pin_thread(int cpu) {
+    cpu_set_t set;
+    int rc;
+
+    if (cpu < 0)
+        return;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if ((rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set)) != 0) {
+        fprintf(stderr, "pthread_setaffinity_np(cpu %d): %s\n", cpu, strerror(rc));
+        return;
+    }
+    if (nnodes > 1 && syscall(SYS_set_mempolicy, MPOL_LOCAL, NULL, 0) < 0)
+        fprintf(stderr, "set_mempolicy: %s\n", strerror(errno));
+    printf("thread pinned to cpu %d (node %d)\n", cpu, topo_node(cpu));
+}
+
+/*
+ * topo_alloc_local - cpu 가 속한 노드에 size 바이트를 할당 (페이지 단위, 0으로 초기화)
+ *
+ * 노드가 하나뿐이거나 cpu < 0 이면 일반 익명 매핑과 같다. 노드가 가득 차면
+ * 다른 노드를 쓰도록 MPOL_PREFERRED 로 묶는다.
+ */
+void *topo_alloc_local(size_t size, int cpu) {
+    unsigned long mask[TOPO_MAX_NODES / (8 * sizeof(unsigned long))];
+    int node = topo_node(cpu);
+    void *p;
+
+    p = Mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (cpu < 0 || nnodes < 2)
+        return p;
+    memset(mask, 0, sizeof(mask));
+    mask[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+    if (syscall(SYS_mbind, p, size, MPOL_PREFERRED, mask, TOPO_MAX_NODES + 1, 0) < 0)
+        fprintf(stderr, "mbind(node %d): %s\n", node, strerror(errno));
+    return p;
+}
+
+/*
+ * topo_thread_create - cpu 의 노드에 스택을 둔 스레드 생성 (프로세스 수명 동안 사는 스레드용)
+ *
+ * 스레드 함수 안에서 pin_thread(cpu) 로 실제 고정을 해야 한다. cpu < 0 이면
+ * 일반 Pthread_create 와 같다. 스택은 해제하지 않으므로 연결마다 만드는
+ * 스레드에는 쓰지 않는다.
+ */
+void topo_thread_create(pthread_t *tid, void *(*routine)(void *), void *arg, int cpu) {
+    pthread_attr_t attr;
+    size_t stacksize;
+    int rc;
+
+    if (cpu < 0 || nnodes < 2) {
+        Pthread_create(tid, NULL, routine, arg);
+        return;
+    }
+    pthread_attr_init(&attr);
+    pthread_attr_getstacksize(&attr, &stacksize);
+    pthread_attr_setstack(&attr, topo_alloc_local(stacksize, cpu), stacksize);
+    if ((rc = pthread_create(tid, &attr, routine, arg)) != 0)
+        posix_error(rc, "Pthread_create error");
+    pthread_attr_destroy(&attr);
+}
+
+/*
+ * topo_print - NUMA 노드별 CPU 와 -c 로 고른 CPU 를 출력
+ */
+void topo_print(FILE *fp) {
+    int node, cpu, i;
+
+    fprintf(fp, "topology: %d NUMA node(s)\n", nnodes);
+    for (node = 0; node < nnodes; node++) {
+        fprintf(fp, "  node %d: cpus", node);
+        for (cpu = 0; cpu < sysconf(_SC_NPROCESSORS_CONF) && cpu < CPU_SETSIZE; cpu++)
+            if (cpu_node[cpu] == node)
+                fprintf(fp, " %d", cpu);
+        fprintf(fp, "\n");
+    }
+    if (ncpus > 0) {
+        fprintf(fp, "  worker cpus:");
+        for (i = 0; i < ncpus; i++)
+            fprintf(fp, " %d", cpus[i]);
+        fprintf(fp, "\n");
+    }
+    fflush(fp);
+}
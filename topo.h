@@ -0,0 +1,18 @@
+/*
+ * topo.h - CPU 고정과 NUMA 노드 로컬 메모리 배치 (-c)
+ */
+#ifndef __TOPO_H__
+#define __TOPO_H__
+
+#include <stdio.h>
+#include <pthread.h>
+
+int topo_init(const char *cpulist);
+int topo_cpu(int i);
+int topo_node(int cpu);
+void pin_thread(int cpu);
+void *topo_alloc_local(size_t size, int cpu);
+void topo_thread_create(pthread_t *tid, void *(*routine)(void *), void *arg, int cpu);
+void topo_print(FILE *fp);
+
+#endif /* __TOPO_H__ */
@@ -0,0 +1,582 @@
+/*
+ * uring.c - io_uring 기반 프록시 엔진 (-m uring, make proxy-uring)
+ *
+ * 블로킹 Accept/Open_clientfd/Rio_writen 경로 대신, 모든 소켓 작업을
+ * io_uring 제출 큐에 쌓아 두고 루프 한 바퀴마다 io_uring_enter 한 번으로
+ * 묶어서 제출한다.
+ *
+ * - accept: 멀티샷 accept 하나로 계속 연결을 받음 (지원하지 않는 커널은
+ *   완료될 때마다 다시 등록)
+ * - connect + 요청 전송: IOSQE_IO_LINK 로 연결한 두 작업을 한 번에 제출
+ * - 응답 중계: 미리 등록한(registered) 고정 버퍼로 READ_FIXED/WRITE_FIXED
+ *
+ * 커널이 io_uring 을 지원하지 않으면(io_uring_setup 실패) epoll 엔진으로
+ * 대체한다. liburing 없이 시스템 콜과 링 메모리를 직접 다룬다.
+ */
+#define _GNU_SOURCE
+#include "proxy.h"
+#include "uring.h"
+#include "admit.h"
+#include "limit.h"
+#include "evloop.h"
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#define UR_ENTRIES   4096           /* 제출 큐 크기 */
+#define UR_NBUFS     256            /* 링마다 등록하는 고정 버퍼 수 */
+#define UR_BUFSIZE   MAXBUF         /* 고정 버퍼 하나의 크기 */
+#define UR_REQ_INIT  1024           /* 요청 버퍼 초기 크기 */
+#define UR_REQ_MAX   (4 * MAXBUF)   /* 요청 헤더 최대 크기 */
+
+/* user_data 하위 3비트에 담는 작업 종류 (연결 구조체는 8바이트 정렬) */
+enum {
+    OP_ACCEPT = 0,      /* user_data == 0 */
+    OP_RECV_REQ,
+    OP_CONNECT,
+    OP_SEND_REQ,
+    OP_READ,
+    OP_WRITE
+};
+#define OP_MASK 7UL
+
+typedef struct uconn {
+    int clientfd, serverfd;
+    int pending;                    /* 커널에 제출했지만 아직 완료되지 않은 작업 수 */
+    int closing;                    /* pending 이 0이 되면 해제 */
+    int connect_failed;
+    char *req;                      /* 요청 수신 버퍼 → 서버로 보낼 요청 */
+    size_t len, cap, off;
+    struct addrinfo *ai_list, *ai;
+    int bufidx;                     /* 고정 버퍼 번호 (-1이면 heap 버퍼 사용) */
+    char *relay;                    /* 중계 버퍼 (고정 버퍼 또는 heap) */
+    size_t rlen, roff;
+    int limited;                    /* 동시성 한도(-A) 자리를 차지하고 있음 */
+    long start;                     /* 서버 작업 시작 시각 (첫 응답 바이트 전까지 0이 아님) */
+} uconn_t;
+
+typedef struct {
+    int fd;                         /* io_uring 파일 디스크립터 */
+    int listenfd;
+    int cpu;                        /* 링 스레드를 고정할 CPU (-1이면 고정하지 않음) */
+    int multishot;                  /* 멀티샷 accept 사용 여부 */
+
+    /* 제출 큐 (SQ) */
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned sq_local_tail;         /* 다음에 채울 SQE 위치 */
+    unsigned to_submit;             /* 다음 io_uring_enter 에서 제출할 SQE 수 */
+
+    /* 완료 큐 (CQ) */
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    /* 등록된 고정 버퍼와 빈 버퍼 스택 */
+    char *bufs;
+    int freebufs[UR_NBUFS];
+    int nfree;
+} uring_t;
+
+static void ur_start_connect(uring_t *r, uconn_t *c);
+static void ur_conn_close(uring_t *r, uconn_t *c);
+
+/* io_uring 시스템 콜 래퍼 (glibc 에는 없음) */
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/*
+ * ur_init - 링을 만들고 SQ/CQ/SQE 영역을 매핑, 고정 버퍼 등록
+ *
+ * 반환값: 성공 0, io_uring 을 쓸 수 없으면 -1 (errno 설정)
+ */
+static int ur_init(uring_t *r, int listenfd, int cpu) {
+    struct io_uring_params p;
+    struct iovec iov[UR_NBUFS];
+    size_t sq_size, cq_size;
+    char *sq_ptr = MAP_FAILED, *cq_ptr = MAP_FAILED;
+    int i, err;
+
+    memset(&p, 0, sizeof(p));
+    memset(r, 0, sizeof(*r));
+    r->listenfd = listenfd;
+    r->cpu = cpu;
+    r->multishot = 1;
+    if ((r->fd = sys_io_uring_setup(UR_ENTRIES, &p)) < 0)
+        return -1;
+
+    sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+        sq_size = cq_size = sq_size > cq_size ? sq_size : cq_size;
+
+    sq_ptr = mmap(NULL, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                  r->fd, IORING_OFF_SQ_RING);
+    if (sq_ptr == MAP_FAILED)
+        goto fail;
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+        cq_ptr = sq_ptr;
+    else {
+        cq_ptr = mmap(NULL, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      r->fd, IORING_OFF_CQ_RING);
+        if (cq_ptr == MAP_FAILED)
+            goto fail;
+    }
+    r->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED)
+        goto fail;
+
+    r->sq_head = (unsigned *)(sq_ptr + p.sq_off.head);
+    r->sq_tail = (unsigned *)(sq_ptr + p.sq_off.tail);
+    r->sq_mask = (unsigned *)(sq_ptr + p.sq_off.ring_mask);
+    r->sq_array = (unsigned *)(sq_ptr + p.sq_off.array);
+    r->sq_local_tail = *r->sq_tail;
+    r->cq_head = (unsigned *)(cq_ptr + p.cq_off.head);
+    r->cq_tail = (unsigned *)(cq_ptr + p.cq_off.tail);
+    r->cq_mask = (unsigned *)(cq_ptr + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)(cq_ptr + p.cq_off.cqes);
+
+    /* 중계용 고정 버퍼 등록: 커널이 매 요청마다 페이지를 고정/해제하지 않음.
+     * 링 스레드가 고정될 CPU 의 노드에 할당 */
+    r->bufs = topo_alloc_local((size_t)UR_NBUFS * UR_BUFSIZE, cpu);
+    for (i = 0; i < UR_NBUFS; i++) {
+        iov[i].iov_base = r->bufs + (size_t)i * UR_BUFSIZE;
+        iov[i].iov_len = UR_BUFSIZE;
+        r->freebufs[i] = UR_NBUFS - 1 - i;
+    }
+    r->nfree = UR_NBUFS;
+    if (sys_io_uring_register(r->fd, IORING_REGISTER_BUFFERS, iov, UR_NBUFS) < 0) {
+        fprintf(stderr, "io_uring: buffer registration failed (%s), using heap buffers\n",
+                strerror(errno));
+        r->nfree = 0;
+    }
+    return 0;
+
+ fail:
+    /* 이미 매핑한 영역을 풀고 닫음 (errno 는 실패한 mmap 의 것을 유지) */
+    err = errno;
+    if (cq_ptr != MAP_FAILED && cq_ptr != sq_ptr)
+        munmap(cq_ptr, cq_size);
+    if (sq_ptr != MAP_FAILED)
+        munmap(sq_ptr, sq_size);
+    close(r->fd);
+    errno = err;
+    return -1;
+}
+
+/*
+ * ur_reserve - 제출 큐에 빈 SQE 가 n개 이상 남도록 보장 (부족하면 먼저 제출)
+ *
+ * 링크로 묶은 작업들이 서로 다른 제출로 나뉘지 않게 하는 데 사용한다.
+ */
+static void ur_reserve(uring_t *r, unsigned n) {
+    unsigned head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+
+    if (r->sq_local_tail - head + n > *r->sq_mask + 1) {
+        if (sys_io_uring_enter(r->fd, r->to_submit, 0, 0) < 0)
+            unix_error("io_uring_enter error");
+        r->to_submit = 0;
+    }
+}
+
+/*
+ * ur_get_sqe - 비어 있는 SQE 하나를 얻음 (큐가 가득 차면 먼저 제출)
+ */
+static struct io_uring_sqe *ur_get_sqe(uring_t *r) {
+    struct io_uring_sqe *sqe;
+
+    ur_reserve(r, 1);
+    sqe = &r->sqes[r->sq_local_tail & *r->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    r->sq_array[r->sq_local_tail & *r->sq_mask] = r->sq_local_tail & *r->sq_mask;
+    r->sq_local_tail++;
+    __atomic_store_n(r->sq_tail, r->sq_local_tail, __ATOMIC_RELEASE);
+    r->to_submit++;
+    return sqe;
+}
+
+/*
+ * ur_prep - 연결 c 의 작업 하나를 SQE 로 준비하고 pending 을 증가
+ */
+static struct io_uring_sqe *ur_prep(uring_t *r, uconn_t *c, int op, int opcode, int fd,
+                                    void *addr, unsigned len) {
+    struct io_uring_sqe *sqe = ur_get_sqe(r);
+
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->addr = (unsigned long)addr;
+    sqe->len = len;
+    sqe->user_data = (unsigned long)c | op;
+    c->pending++;
+    return sqe;
+}
+
+static void ur_arm_accept(uring_t *r) {
+    struct io_uring_sqe *sqe = ur_get_sqe(r);
+
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = r->listenfd;
+    if (r->multishot)
+        sqe->ioprio |= IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = OP_ACCEPT;
+}
+
+static void ur_recv_req(uring_t *r, uconn_t *c) {
+    ur_prep(r, c, OP_RECV_REQ, IORING_OP_RECV, c->clientfd,
+            c->req + c->len, c->cap - c->len - 1);
+}
+
+/*
+ * ur_read / ur_write - 중계 버퍼로 서버 읽기, 클라이언트 쓰기
+ */
+static void ur_read(uring_t *r, uconn_t *c) {
+    struct io_uring_sqe *sqe;
+
+    if (c->bufidx >= 0) {
+        sqe = ur_prep(r, c, OP_READ, IORING_OP_READ_FIXED, c->serverfd, c->relay, UR_BUFSIZE);
+        sqe->buf_index = c->bufidx;
+    } else
+        ur_prep(r, c, OP_READ, IORING_OP_READ, c->serverfd, c->relay, UR_BUFSIZE);
+}
+
+static void ur_write(uring_t *r, uconn_t *c) {
+    struct io_uring_sqe *sqe;
+
+    if (c->bufidx >= 0) {
+        sqe = ur_prep(r, c, OP_WRITE, IORING_OP_WRITE_FIXED, c->clientfd,
+                      c->relay + c->roff, c->rlen - c->roff);
+        sqe->buf_index = c->bufidx;
+    } else
+        ur_prep(r, c, OP_WRITE, IORING_OP_WRITE, c->clientfd,
+                c->relay + c->roff, c->rlen - c->roff);
+}
+
+/*
+ * ur_conn_close - 소켓을 닫고, 진행 중인 작업이 모두 끝나면 구조체 해제
+ */
+static void ur_conn_close(uring_t *r, uconn_t *c) {
+    if (!c->closing) {
+        c->closing = 1;
+        close(c->clientfd);
+        if (c->serverfd >= 0)
+            close(c->serverfd);
+        c->clientfd = c->serverfd = -1;
+        if (c->limited)
+            limit_release();
+        admit_end();
+    }
+    if (c->pending > 0)
+        return;
+    if (c->ai_list)
+        freeaddrinfo(c->ai_list);
+    if (c->bufidx >= 0)
+        r->freebufs[r->nfree++] = c->bufidx;
+    else
+        free(c->relay);
+    free(c->req);
+    free(c);
+}
+
+/*
+ * ur_start_request - 요청 헤더를 다 모았으면 파싱하고 서버 연결을 시작
+ */
+static void ur_start_request(uring_t *r, uconn_t *c) {
+    char method[MAXLINE], uri[MAXLINE], version[MAXLINE];
+    char hostname[MAXLINE], path[MAXLINE], portstr[8];
+    struct addrinfo hints;
+    char *hdrs, *out;
+    int port, rc;
+
+    printf("Request line: %.*s", (int)(strstr(c->req, "\r\n") - c->req + 2), c->req);
+    hdrs = strstr(c->req, "\r\n") + 2;
+    if (parse_request_line(c->req, method, uri, version) < 0 ||
+        strcasecmp(method, "GET")) {
+        ur_conn_close(r, c);
+        return;
+    }
+    parse_uri(uri, hostname, path, &port);
+    sprintf(portstr, "%d", port);
+
+    /* 동시 서버 작업 수 한도 (-A): 링을 막을 수 없으므로 차 있으면 바로 503 */
+    if (!limit_acquire(0)) {
+        admit_send_busy(c->clientfd);
+        ur_conn_close(r, c);
+        return;
+    }
+    c->limited = 1;
+    c->start = limit_now();
+
+    out = Malloc(strlen(path) + strlen(hdrs) + REQUEST_TAIL_MAX + 32);
+    c->len = build_request(out, path, hdrs);
+    c->off = 0;
+    free(c->req);
+    c->req = out;
+
+    memset(&hints, 0, sizeof(struct addrinfo));
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_NUMERICSERV | AI_ADDRCONFIG;
+    if ((rc = getaddrinfo(hostname, portstr, &hints, &c->ai_list)) != 0) {
+        fprintf(stderr, "getaddrinfo failed (%s:%s): %s\n", hostname, portstr, gai_strerror(rc));
+        c->ai_list = NULL;
+        ur_conn_close(r, c);
+        return;
+    }
+    c->ai = c->ai_list;
+    ur_start_connect(r, c);
+}
+
+/*
+ * ur_start_connect - connect 와 요청 전송을 링크로 묶어 한 번에 제출
+ *
+ * connect 가 실패하면 커널이 뒤따르는 send 를 -ECANCELED 로 완료시킨다.
+ */
+static void ur_start_connect(uring_t *r, uconn_t *c) {
+    struct io_uring_sqe *sqe;
+
+    for (; c->ai; c->ai = c->ai->ai_next) {
+        struct addrinfo *p = c->ai;
+        if ((c->serverfd = socket(p->ai_family, p->ai_socktype, p->ai_protocol)) < 0)
+            continue;
+        c->connect_failed = 0;
+        ur_reserve(r, 2);
+        sqe = ur_prep(r, c, OP_CONNECT, IORING_OP_CONNECT, c->serverfd, p->ai_addr, 0);
+        sqe->off = p->ai_addrlen;
+        sqe->flags |= IOSQE_IO_LINK;
+        sqe = ur_prep(r, c, OP_SEND_REQ, IORING_OP_SEND, c->serverfd, c->req, c->len);
+        sqe->msg_flags = MSG_WAITALL;
+        return;
+    }
+    printf("Failed to connect to end server\n");
+    ur_conn_close(r, c);
+}
+
+/*
+ * ur_start_relay - 중계 버퍼를 확보하고 첫 서버 읽기를 제출
+ */
+static void ur_start_relay(uring_t *r, uconn_t *c) {
+    free(c->req);
+    c->req = NULL;
+    if (r->nfree > 0) {
+        c->bufidx = r->freebufs[--r->nfree];
+        c->relay = r->bufs + (size_t)c->bufidx * UR_BUFSIZE;
+    } else {
+        c->bufidx = -1;             /* 고정 버퍼가 모두 사용 중 */
+        c->relay = Malloc(UR_BUFSIZE);
+    }
+    ur_read(r, c);
+}
+
+/*
+ * ur_on_accept - 새 연결을 받아 요청 수신을 시작
+ */
+static void ur_on_accept(uring_t *r, struct io_uring_cqe *cqe) {
+    uconn_t *c;
+
+    if (!(cqe->flags & IORING_CQE_F_MORE)) {
+        /* 멀티샷이 끝났거나 지원되지 않음: 다시 등록 */
+        if (cqe->res == -EINVAL && r->multishot) {
+            r->multishot = 0;
+            ur_arm_accept(r);
+            return;
+        }
+        ur_arm_accept(r);
+    }
+    if (cqe->res < 0) {
+        if (cqe->res != -EINTR && cqe->res != -EAGAIN)
+            fprintf(stderr, "accept error: %s\n", strerror(-cqe->res));
+        return;
+    }
+    if (!admit_accept(cqe->res))    /* 한도 초과: 503 을 보내고 이미 닫힘 */
+        return;
+    admit_begin();
+
+    c = Calloc(1, sizeof(uconn_t));
+    c->clientfd = cqe->res;
+    c->serverfd = -1;
+    c->bufidx = -1;
+    c->cap = UR_REQ_INIT;
+    c->req = Malloc(c->cap);
+    ur_recv_req(r, c);
+}
+
+/*
+ * ur_complete - 연결 작업 하나의 완료 처리
+ */
+static void ur_complete(uring_t *r, uconn_t *c, int op, int res) {
+    c->pending--;
+    if (c->closing) {
+        ur_conn_close(r, c);
+        return;
+    }
+
+    switch (op) {
+    case OP_RECV_REQ:
+        if (res <= 0) {
+            ur_conn_close(r, c);
+            return;
+        }
+        c->len += res;
+        c->req[c->len] = '\0';
+        if (strstr(c->req, "\r\n\r\n")) {
+            ur_start_request(r, c);
+            return;
+        }
+        if (c->len + 1 == c->cap) {
+            if (c->cap >= UR_REQ_MAX) {
+                ur_conn_close(r, c);
+                return;
+            }
+            c->cap *= 2;
+            c->req = Realloc(c->req, c->cap);
+        }
+        ur_recv_req(r, c);
+        return;
+
+    case OP_CONNECT:
+        if (res < 0)
+            c->connect_failed = 1;  /* 링크된 send 의 취소 완료를 기다림 */
+        return;
+
+    case OP_SEND_REQ:
+        if (c->connect_failed) {    /* 다음 주소로 재시도 */
+            close(c->serverfd);
+            c->serverfd = -1;
+            c->ai = c->ai->ai_next;
+            ur_start_connect(r, c);
+            return;
+        }
+        if (res < 0) {
+            ur_conn_close(r, c);
+            return;
+        }
+        c->off += res;
+        if (c->off < c->len) {      /* 일부만 전송됨: 나머지 전송 */
+            ur_prep(r, c, OP_SEND_REQ, IORING_OP_SEND, c->serverfd,
+                    c->req + c->off, c->len - c->off);
+            return;
+        }
+        ur_start_relay(r, c);
+        return;
+
+    case OP_READ:
+        if (res <= 0) {             /* 서버 응답 끝 또는 오류 */
+            ur_conn_close(r, c);
+            return;
+        }
+        if (c->start) {             /* 첫 응답 바이트: 서버 지연 샘플 */
+            limit_sample(limit_now() - c->start);
+            c->start = 0;
+        }
+        c->rlen = res;
+        c->roff = 0;
+        ur_write(r, c);
+        return;
+
+    case OP_WRITE:
+        if (res <= 0) {             /* 클라이언트가 끊김 */
+            ur_conn_close(r, c);
+            return;
+        }
+        c->roff += res;
+        if (c->roff < c->rlen)
+            ur_write(r, c);
+        else
+            ur_read(r, c);
+        return;
+    }
+}
+
+/*
+ * uring_thread - 링 하나를 구동하는 스레드 함수
+ *
+ * 핸들러들이 쌓은 SQE 는 다음 io_uring_enter 에서 한꺼번에 제출된다.
+ */
+static void *uring_thread(void *vargp) {
+    uring_t *r = vargp;
+    unsigned head, tail;
+
+    pin_thread(r->cpu);
+    ur_arm_accept(r);
+    while (1) {
+        if (sys_io_uring_enter(r->fd, r->to_submit, 1, IORING_ENTER_GETEVENTS) < 0) {
+            if (errno == EINTR)
+                continue;
+            unix_error("io_uring_enter error");
+        }
+        r->to_submit = 0;
+
+        head = *r->cq_head;
+        tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+        while (head != tail) {
+            struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+            unsigned long ud = cqe->user_data;
+
+            if (ud == OP_ACCEPT)
+                ur_on_accept(r, cqe);
+            else
+                ur_complete(r, (uconn_t *)(ud & ~OP_MASK), ud & OP_MASK, cqe->res);
+            head++;
+        }
+        __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+/*
+ * uring_start - listenfd 를 처리하는 링 하나를 만들어 스레드로 구동
+ *
+ * 반환값: 성공 0, 커널이 io_uring 을 지원하지 않으면 -1
+ */
+int uring_start(int listenfd, int cpu) {
+    uring_t *r = Malloc(sizeof(uring_t));
+    pthread_t tid;
+
+    if (ur_init(r, listenfd, cpu) < 0) {
+        Free(r);
+        return -1;
+    }
+    topo_thread_create(&tid, uring_thread, r, cpu);
+    Pthread_detach(tid);
+    return 0;
+}
+
+/*
+ * uring_run - nloops 개의 링을 만들어 구동 (반환하지 않음)
+ *
+ * 첫 링을 만들 수 없으면 커널이 io_uring 을 지원하지 않는 것으로 보고
+ * epoll 엔진으로 대체한다. 그 뒤의 링이 실패하면 (RLIMIT_MEMLOCK 등)
+ * 이미 만든 링들로만 구동한다.
+ */
+void uring_run(int listenfd, int nloops) {
+    uring_t *rings = Calloc(nloops, sizeof(uring_t));
+    pthread_t tid;
+    int i;
+
+    for (i = 0; i < nloops; i++) {
+        if (ur_init(&rings[i], listenfd, topo_cpu(i)) < 0) {
+            if (i == 0) {
+                fprintf(stderr, "io_uring unavailable (%s), falling back to epoll\n",
+                        strerror(errno));
+                Free(rings);
+                evloop_run(listenfd, nloops);
+            }
+            fprintf(stderr, "io_uring: ring %d failed (%s), running with %d rings\n",
+                    i, strerror(errno), i);
+            nloops = i;
+            break;
+        }
+    }
+    for (i = 1; i < nloops; i++) {
+        topo_thread_create(&tid, uring_thread, &rings[i], rings[i].cpu);
+        Pthread_detach(tid);
+    }
+    uring_thread(&rings[0]);
+}
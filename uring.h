@@ -0,0 +1,13 @@
+/*
+ * uring.h - io_uring 기반 엔진 (-m uring, make proxy-uring 으로 빌드)
+ */
+#ifndef __URING_H__
+#define __URING_H__
+
+/* nloops 개의 링으로 listenfd 의 연결을 처리 (반환하지 않음, 실패 시 epoll 로 대체) */
+void uring_run(int listenfd, int nloops);
+
+/* listenfd 를 처리하는 링 하나를 띄움 (cpu >= 0 이면 고정). io_uring 을 쓸 수 없으면 -1 */
+int uring_start(int listenfd, int cpu);
+
+#endif /* __URING_H__ */
@@ -0,0 +1,80 @@
+/*
+ * vary.c - Vary 응답 헤더로 같은 URI 의 캐시 변형을 고르는 키
+ *
+ * 서버가 "Vary: Accept-Encoding" 처럼 응답이 요청의 어떤 헤더에 따라
+ * 달라지는지 알려 주면, 캐시는 URI 하나에 변형을 여럿 두고 요청의 그
+ * 헤더 값들로 고른다 (cache.c). 여기서는 두 가지를 정규화한다:
+ *
+ * - 이름 목록: 소문자로 바꾸고 공백을 빼서 "accept-encoding,accept," 처럼
+ *   (이름마다 쉼표로 끝나므로 Vary 가 여러 줄이어도 이어 붙이면 됨).
+ *   "*" 는 요청 헤더로는 고를 수 없다는 뜻이므로 그대로 "*" 로 둔다.
+ * - 변형 키: 목록의 이름마다 요청에서 그 헤더 값들을 찾아 (여러 줄이면
+ *   쉼표로 잇고) 공백을 빼고 소문자로 바꾼 뒤 줄바꿈으로 구분해 잇는다.
+ *   "gzip, deflate" 와 "GZIP,deflate" 는 같은 변형이 된다. 헤더가 없는
+ *   요청은 빈 값으로 센다.
+ */
+#include "csapp.h"
+#include "vary.h"
+
+/* put - out[*n] 에 c 를 넣음 (자리가 없으면 -1) */
+static int put(char *out, size_t size, size_t *n, char c) {
+    if (*n + 1 >= size)
+        return -1;
+    out[(*n)++] = c;
+    return 0;
+}
+
+void vary_fields(char *out, size_t size, const char *value) {
+    const char *v = value;
+    size_t n = strlen(out), len, i;
+
+    if (!strcmp(out, "*"))
+        return;
+    while (*v && *v != '\r' && *v != '\n') {
+        while (*v == ' ' || *v == '\t' || *v == ',')
+            v++;
+        len = strcspn(v, ", \t\r\n");
+        if ((len == 1 && *v == '*') || n + len + 2 > size) {
+            strcpy(out, "*");
+            return;
+        }
+        for (i = 0; i < len; i++)
+            out[n++] = tolower((unsigned char)v[i]);
+        if (len > 0)
+            out[n++] = ',';             /* 이름마다 쉼표로 끝냄 */
+        v += len;
+    }
+    out[n] = '\0';
+}
+
+int vary_key(const char *fields, const char *hdrs, size_t len, char *out, size_t size) {
+    const char *f = fields, *p, *eol, *end = hdrs + len;
+    size_t n = 0, flen;
+    int first;
+
+    while (*f) {
+        flen = strcspn(f, ",");
+        first = 1;
+        for (p = hdrs; hdrs && p < end; p = eol) {
+            if ((eol = memchr(p, '\n', end - p)) != NULL)
+                eol++;
+            else
+                eol = end;
+            if ((size_t)(eol - p) <= flen || strncasecmp(p, f, flen) || p[flen] != ':')
+                continue;
+            if (!first && put(out, size, &n, ',') < 0)
+                return -1;
+            first = 0;
+            for (p += flen + 1; p < eol && *p != '\r' && *p != '\n'; p++)
+                if (*p != ' ' && *p != '\t' && put(out, size, &n, tolower((unsigned char)*p)) < 0)
+                    return -1;
+        }
+        if (put(out, size, &n, '\n') < 0)
+            return -1;
+        f += flen;
+        if (*f == ',')
+            f++;
+    }
+    out[n] = '\0';
+    return 0;
+}
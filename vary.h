@@ -0,0 +1,21 @@
+/*
+ * vary.h - Vary 응답 헤더로 같은 URI 의 캐시 변형을 고르는 키
+ */
+#ifndef __VARY_H__
+#define __VARY_H__
+
+#include <stddef.h>
+
+/* 정규화한 Vary 이름 목록과 변형 키의 최대 길이 */
+#define VARY_MAX 256
+
+/* Vary 헤더 값의 이름들을 소문자로, 쉼표로만 구분해 out 에 덧붙임.
+ * "*" 가 있거나 out 에 다 들어가지 않으면 out 은 "*" (어떤 요청에도 맞지 않음) */
+void vary_fields(char *out, size_t size, const char *value);
+
+/* 요청 헤더들 hdrs ("이름: 값\r\n" 줄들, len 바이트) 에서 fields 에 든
+ * 헤더들의 값을 정규화해 이어 붙인 변형 키를 out 에 만듦.
+ * 반환값: 0, out 에 다 들어가지 않으면 -1 */
+int vary_key(const char *fields, const char *hdrs, size_t len, char *out, size_t size);
+
+#endif /* __VARY_H__ */